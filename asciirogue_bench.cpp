@@ -0,0 +1,274 @@
+// Micro-benchmarks for the asciirogue_v2 engine kernels.
+// Build: cmake -S . -B build && cmake --build build --target asciirogue_bench
+//    or: g++ -std=c++17 -O2 -pthread asciirogue_bench.cpp asciirogue_engine.cpp -o asciirogue_bench
+// Run:   ./asciirogue_bench [--filter SUBSTR] [--min-time SECONDS]
+//        ./asciirogue_bench --hashes N    (per-seed level and frame hashes instead of timings; diff two builds)
+// Output follows Google Benchmark's console layout: name, ns/iter, iterations, plus allocs/iter.
+// Cases registered with an allocation budget fail the run (exit 1) when the loop allocates more per iteration,
+// and so does a failed self-check (an optimized kernel compared against a plain reference) run before the table;
+// build with -DASCIIROGUE_MEMTAGS for a per-subsystem breakdown after the table.
+#include "asciirogue_engine.hpp"
+
+namespace bench {
+
+using Clock=std::chrono::steady_clock;
+static uint64_t allocs_now(){ return prof::state().cnt[prof::Allocs].load(); }
+
+// Per-run handle: the body loops while(st.keep_running()) and does one iteration per pass.
+// Time and allocations are taken around the loop only, after one untimed warm-up pass, so neither
+// per-case setup nor first-use container growth is charged.
+struct State{
+    int64_t max_iters=1, iters=0; Clock::time_point t0, t1; uint64_t a0=0, a1=0;
+    bool keep_running(){
+        if(iters==1){ a0=allocs_now(); t0=Clock::now(); }
+        if(iters++ <= max_iters) return true;
+        t1=Clock::now(); a1=allocs_now(); return false;
+    }
+};
+struct Case{ std::string name; std::function<void(State&)> fn; double budget; };
+static std::vector<Case>& registry(){ static std::vector<Case> r; return r; }
+// budget: max heap allocations per iteration, or negative for none
+static void add(const std::string& name, std::function<void(State&)> fn, double budget=-1){ registry().push_back({name,std::move(fn),budget}); }
+
+// Sink that swallows terminal output so render/flush cost excludes the tty.
+struct NullBuf: std::streambuf{ int overflow(int ch) override { return traits_type::not_eof(ch); } std::streamsize xsputn(const char*, std::streamsize n) override { return n; } };
+
+static bool run(const Case& c, double min_time){
+    State st; double secs=0; uint64_t allocs=0;
+    // grow the iteration count until one timed run covers min_time, like benchmark::RunSpecifiedBenchmarks
+    while(true){
+        st.iters=0;
+        c.fn(st);
+        allocs=st.a1-st.a0;
+        secs=std::chrono::duration<double>(st.t1-st.t0).count();
+        if(secs>=min_time || st.max_iters>=(int64_t)1<<30) break;
+        double grow = secs>0? std::min(10.0, 1.4*min_time/secs) : 10.0;
+        st.max_iters=std::max<int64_t>(st.max_iters+1,(int64_t)(st.max_iters*grow));
+    }
+    std::cout<<std::left<<std::setw(40)<<c.name<<std::right<<std::setw(14)<<std::fixed<<std::setprecision(0)<<secs*1e9/st.max_iters<<" ns"
+             <<std::setw(12)<<st.max_iters<<std::setw(14)<<std::setprecision(1)<<(double)allocs/st.max_iters<<" allocs/it";
+    bool over= c.budget>=0 && (double)allocs/st.max_iters>c.budget;
+    if(over) std::cout<<"  OVER BUDGET ("<<c.budget<<")";
+    std::cout<<"\n";
+    return !over;
+}
+
+static std::string dims(int h,int w){ return std::to_string(h)+"x"+std::to_string(w); }
+
+// Deterministic level of the given size with every door open, so paths exist between rooms.
+static Game make_level(int h,int w,uint64_t seed){
+    Game g(h,w); g.rng=RNG(seed);
+    new_game(g);
+    for(auto& c: g.map.g) if(c.t==Tile::DoorClosed) c.t=Tile::DoorOpen;
+    return g;
+}
+
+static const std::pair<int,int> sizes[]={{24,80},{128,128},{512,512},{1024,1024}};
+
+static void register_all(){
+    for(auto [h,w]: sizes){
+        add("BM_generate_dungeon/"+dims(h,w),[h=h,w=w](State& st){
+            Map m(h,w); RNG rng(1); Biome biome{};
+            while(st.keep_running()){ auto rooms=generate_dungeon(m,rng,biome); (void)rooms; }
+        });
+        add("BM_generate_caves/"+dims(h,w),[h=h,w=w](State& st){
+            Map m(h,w); RNG rng(1);
+            while(st.keep_running()){ auto anchors=gen_caves(m,rng); (void)anchors; }
+        });
+        add("BM_generate_bsp/"+dims(h,w),[h=h,w=w](State& st){
+            Map m(h,w); RNG rng(1);
+            while(st.keep_running()){ m.clear(); auto rooms=gen_bsp(m,rng); (void)rooms; }
+        });
+        add("BM_compute_fov/"+dims(h,w),[h=h,w=w](State& st){
+            Game g=make_level(h,w,2);
+            while(st.keep_running()) compute_fov(g.map,g.player.pos.r,g.player.pos.c,10);
+        },0);
+        add("BM_astar/"+dims(h,w),[h=h,w=w](State& st){
+            Game g=make_level(h,w,3);
+            Pos to=g.teleporter.r>=0? g.teleporter : g.player.pos; std::vector<Pos> path;
+            while(st.keep_running()) astar(g.map,g.player.pos,to,path);
+        },0);
+        add("BM_renderbuf_flush/"+dims(h,w),[h=h,w=w](State& st){
+            Game g=make_level(h,w,4); compute_fov(g.map,g.player.pos.r,g.player.pos.c,10);
+            NullBuf sink; std::streambuf* old=std::cout.rdbuf(&sink);
+            RenderBuf rb(g.map.H,g.map.W);
+            for(int r=0;r<g.map.H;r++) for(int c=0;c<g.map.W;c++) rb.set(r,c,tile_glyph(g.map.at(r,c)),(Color)((r+c)%13));
+            while(st.keep_running()) rb.flush();
+            std::cout.rdbuf(old);
+        });
+        add("BM_save_load/"+dims(h,w),[h=h,w=w](State& st){
+            Game g=make_level(h,w,5); Game back(h,w);
+            const std::string path="asciirogue_bench_save.tmp";
+            while(st.keep_running()){ save_game(g,path); load_game(back,path); }
+            std::remove(path.c_str());
+        });
+        // the autosave's main-thread share: unchanged map bands are shared with the previous snapshot
+        add("BM_save_snapshot/"+dims(h,w),[h=h,w=w](State& st){
+            Game g=make_level(h,w,5); auto last=snapshot(g);
+            while(st.keep_running()) last=snapshot(g,last.get());
+        });
+    }
+    // the same kernels on the compile-time-shaped map, fed the 24x80 level above
+    add("BM_compute_fov_fixed/24x80",[](State& st){
+        Game g=make_level(24,80,2); FixedMap<24,80> m(24,80); m.g=g.map.g;
+        while(st.keep_running()) compute_fov(m,g.player.pos.r,g.player.pos.c,10);
+    },0);
+    add("BM_astar_fixed/24x80",[](State& st){
+        Game g=make_level(24,80,3); FixedMap<24,80> m(24,80); m.g=g.map.g;
+        Pos to=g.teleporter.r>=0? g.teleporter : g.player.pos; std::vector<Pos> path;
+        while(st.keep_running()) astar(m,g.player.pos,to,path);
+    },0);
+    for(int n: {16,128,1024}){
+        add("BM_ai_turn/"+std::to_string(n)+"_mobs",[n](State& st){
+            Game g(128,128); g.rng=RNG(6); new_game(g);
+            for(int r=1;r<g.map.H-1;r++) for(int c=1;c<g.map.W-1;c++) g.map.at(r,c).t=Tile::Floor;
+            g.ents.clear(); g.grid.reset(g.map.H,g.map.W); g.player.pos={64,64}; g.player.mob.st.hp=1<<30;
+            RNG rng(7);
+            for(int i=0;i<n;i++){ Entity e{}; e.type=EntityType::Mob; e.pos={rng.i(1,126),rng.i(1,126)}; e.mob=make_mon(rng,1); spawn(g,e); }
+            compute_fov(g.map,g.player.pos.r,g.player.pos.c,10);
+            while(st.keep_running()) ai_turn(g);
+        },0);
+    }
+}
+
+// ---------------- Self-checks ----------------
+// Run before the table; a failed check fails the run like an over-budget case, so a faster kernel that
+// changes results can't pass as a speedup.
+struct Check{ std::string name; std::function<bool(std::string&)> fn; };
+static std::vector<Check>& checks(){ static std::vector<Check> c; return c; }
+
+// The 4-5 rule cell by cell, straight from its definition: border cells are wall, any other cell is wall
+// when at least 5 of the 9 cells around it are.
+static Bitboard ca_reference(const Bitboard& in){
+    Bitboard out(in.H,in.W);
+    for(int r=0;r<in.H;r++) for(int c=0;c<in.W;c++){
+        if(r==0 || c==0 || r==in.H-1 || c==in.W-1){ out.set(r,c,true); continue; }
+        int n=0; for(int dr=-1;dr<=1;dr++) for(int dc=-1;dc<=1;dc++) n+=in.get(r+dr,c+dc);
+        out.set(r,c,n>=5);
+    }
+    return out;
+}
+
+// ca_step against ca_reference on random boards: widths either side of the 64-bit word edges, wall
+// densities from sparse to dense, five chained steps each as gen_caves runs them.
+static bool check_ca_step(std::string& err){
+    static const std::pair<int,int> shapes[]={{3,3},{5,17},{7,63},{7,64},{9,65},{24,80},{40,127},{40,128},{33,190}};
+    FastRNG fr{12345}; int boards=0;
+    for(auto [h,w]: shapes) for(int density=1; density<=7; density+=2) for(int rep=0; rep<4; rep++){
+        Bitboard a(h,w), b(h,w);
+        for(int r=0;r<h;r++) for(int c=0;c<w;c++) a.set(r,c,fr.i(0,7)<density);
+        a.wall_border();
+        for(int step=0; step<5; step++, boards++){
+            Bitboard want=ca_reference(a);
+            ca_step(a,b);
+            for(int r=0;r<h;r++) for(int c=0;c<w;c++) if(b.get(r,c)!=want.get(r,c)){
+                err="ca_step differs from the per-cell rule on a "+dims(h,w)+" board (density "+std::to_string(density)+"/8, step "
+                    +std::to_string(step+1)+") at ("+std::to_string(r)+","+std::to_string(c)+")";
+                return false;
+            }
+            std::swap(a,b);
+        }
+    }
+    err=std::to_string(boards)+" boards";
+    return true;
+}
+
+// ---------------- Golden hashes ----------------
+// --hashes N prints, for seeds 1..N, a hash of the first three generated levels and a hash of every frame of
+// a scripted 400-turn game. Diff the output of two builds to show that a change leaves generation or play alone.
+struct Fnv{ uint64_t h=1469598103934665603ULL;
+    void bytes(const void* p, size_t n){ auto* b=(const unsigned char*)p; for(size_t i=0;i<n;i++){ h^=b[i]; h*=1099511628211ULL; } }
+    void add(int64_t v){ bytes(&v,sizeof v); } };
+
+// tiles plus every live entity, field by field (struct padding is not part of the hash)
+static void hash_level(Fnv& f, const Game& g){
+    f.add(g.map.H); f.add(g.map.W); f.add((int)g.biome);
+    for(int r=0;r<g.map.H;r++) for(int c=0;c<g.map.W;c++) f.add((int)g.map.at(r,c).t);
+    for(auto& e: g.ents) if(!e.gone){
+        f.add((int)e.type); f.add(e.pos.r); f.add(e.pos.c); f.add(e.mob.proto); f.add(e.mob.st.max_hp); f.add(e.mob.st.atk); f.add(e.mob.st.def);
+        f.add(e.item.proto); f.add(e.item.power); f.add(e.chest.locked); f.add(e.chest.content.proto);
+    }
+    f.add(g.player.pos.r); f.add(g.player.pos.c);
+}
+
+static uint64_t map_hash(uint64_t seed){
+    Game g(24,80); g.rng=RNG(seed); Fnv f;
+    new_game(g); hash_level(f,g);
+    for(int lv=0; lv<2; lv++){ next_level(g); hash_level(f,g); }
+    return f.h;
+}
+
+// Random walk with bombs, spells, pickups and item use, so combat, statuses, traps and level changes all run.
+// Each turn's composed frame (grid, colors and HUD text) goes into the hash.
+static uint64_t play_hash(uint64_t seed, int turns, int& deaths, int& level){
+    Game g(24,80); g.rng=RNG(seed); Fnv f; Frame fr;
+    new_game(g);
+    RNG drv(seed*7+1); deaths=0;
+    for(int t=0;t<turns;t++){
+        compute_fov(g.map,g.player.pos.r,g.player.pos.c,10);
+        int k=drv.i(0,9);
+        if(k<7){ Pos d=kDir4[drv.i(0,3)]; move_or_attack(g,d.r,d.c); }
+        else if(k==7){
+            if(t%5==0){ Entity b{}; b.type=EntityType::BombPlaced; b.blocks=false; b.pos=g.player.pos; b.fuse=2; spawn(g,b); }
+            else if(t%5==1){ g.player.mob.st.mp=20; cast_fireball(g,{g.player.pos.r+1,g.player.pos.c}); }
+            else if(t%5==2){ g.player.mob.st.mp=20; cast_firebolt(g,0,1); }
+            else search(g);
+        }
+        else if(k==8) pickup(g);
+        else if(!g.inv.items.empty()) use_item(g,0);
+        ai_turn(g); process_statuses(g); world_tick(g);
+        compute_fov(g.map,g.player.pos.r,g.player.pos.c,10);
+        compose(g,fr);
+        f.bytes(fr.rb.ch.data(),fr.rb.ch.size());
+        for(Color c: fr.rb.col) f.add((int)c);
+        f.bytes(fr.text.data(),fr.text.size());
+        if(g.player.mob.st.hp<=0){ deaths++; new_game(g); }
+        if(drv.chance(0.02)) next_level(g);
+        if(!g.running){ new_game(g); g.running=true; }
+    }
+    level=g.level;
+    return f.h;
+}
+
+static void print_hashes(int seeds){
+    Fnv all;
+    for(int s=1;s<=seeds;s++){
+        int deaths=0, level=0;
+        uint64_t m=map_hash((uint64_t)s), p=play_hash((uint64_t)s,400,deaths,level);
+        all.add((int64_t)m); all.add((int64_t)p);
+        std::cout<<"seed "<<std::setw(4)<<s<<"  map "<<std::hex<<std::setw(16)<<std::setfill('0')<<m<<"  play "<<std::setw(16)<<p
+                 <<std::dec<<std::setfill(' ')<<"  deaths "<<deaths<<"  level "<<level<<"\n";
+    }
+    std::cout<<"all "<<std::hex<<std::setw(16)<<std::setfill('0')<<all.h<<std::dec<<std::setfill(' ')<<"\n";
+}
+
+static void register_checks(){
+    checks().push_back({"ca_step",check_ca_step});
+}
+
+} // namespace bench
+
+int main(int argc, char** argv){
+    std::string filter; double min_time=0.2; int hash_seeds=0;
+    for(int i=1;i<argc;i++){
+        std::string a=argv[i];
+        if(a=="--filter" && i+1<argc) filter=argv[++i];
+        else if(a=="--min-time" && i+1<argc) min_time=std::atof(argv[++i]);
+        else if(a=="--hashes" && i+1<argc) hash_seeds=std::atoi(argv[++i]);
+    }
+    if(hash_seeds>0){ bench::print_hashes(hash_seeds); return 0; }
+    bench::register_all(); bench::register_checks();
+    bool ok=true;
+    for(auto& c: bench::checks()){
+        std::string msg; bool pass=c.fn(msg);
+        std::cout<<"self-check "<<c.name<<": "<<(pass? "ok ("+msg+")" : "FAILED: "+msg)<<"\n";
+        ok&=pass;
+    }
+    std::cout<<std::left<<std::setw(40)<<"Benchmark"<<std::right<<std::setw(17)<<"Time"<<std::setw(12)<<"Iterations"<<std::setw(16)<<"Allocs"<<"\n";
+    std::cout<<std::string(92,'-')<<"\n";
+    for(auto& c: bench::registry()) if(filter.empty() || c.name.find(filter)!=std::string::npos) ok&=bench::run(c,min_time);
+#ifdef ASCIIROGUE_MEMTAGS
+    std::cout<<"\n"; prof::end_frame(); prof::mem_report(std::cout);
+#endif
+    return ok? 0 : 1;
+}
@@ -0,0 +1,1527 @@
+#include "asciirogue_engine.hpp"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+// Global allocation counter for the profiler. Kept out of line so GCC doesn't pair the inlined free() with builtin new.
+#if defined(__GNUC__)
+  #define PROF_NOINLINE __attribute__((noinline))
+#else
+  #define PROF_NOINLINE
+#endif
+#ifdef ASCIIROGUE_MEMTAGS
+// 16-byte header in front of every block: its size and the tag it is charged to.
+struct alignas(16) MemHdr{ std::size_t n; prof::MemTag tag; };
+PROF_NOINLINE void* operator new(std::size_t n){
+    prof::count(prof::Allocs);
+    auto* h=(MemHdr*)std::malloc(sizeof(MemHdr)+n); if(!h) throw std::bad_alloc();
+    h->n=n; h->tag=prof::mem_tag(); prof::mem_alloc(h->tag,n);
+    return h+1;
+}
+PROF_NOINLINE void operator delete(void* p) noexcept { if(!p) return; auto* h=(MemHdr*)p-1; prof::mem_free(h->tag,h->n); std::free(h); }
+PROF_NOINLINE void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+#else
+PROF_NOINLINE void* operator new(std::size_t n){ prof::count(prof::Allocs); if(void* p=std::malloc(n?n:1)) return p; throw std::bad_alloc(); }
+PROF_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+PROF_NOINLINE void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
+static void explode_at(Game& g, int r, int c, int radius, bool square=false);
+static void level_up(Game& g);
+static void grant_xp(Game& g,int amt);
+
+// ---------------- Arenas ----------------
+// Per-thread scratch for one call's temporaries (A*, travel BFS). Declare the scope before the
+// containers that use it so they are gone before it rewinds. Per thread because AI planning runs on the pool.
+Arena& scratch(){ thread_local Arena a(256<<10); return a; }
+
+// ---------------- Entities/Items ----------------
+static void fx_refresh(PlayerStatus& ps){ unsigned m=0; for(int k=0;k<FxCount;k++) m|=(unsigned)(ps.fx[k]>0)<<k; ps.mask=(uint8_t)m; }
+static void fx_add(PlayerStatus& ps, FxKind k, int n){ ps.fx[k]=(int16_t)(ps.fx[k]+n); fx_refresh(ps); }
+static void fx_set(PlayerStatus& ps, FxKind k, int v){ ps.fx[k]=(int16_t)v; fx_refresh(ps); }
+// One tick of every timer; returns the burn/poison damage due (regen is applied to st in place).
+static int fx_tick(PlayerStatus& ps, Stats& st){
+    int dmg=(ps.fx[FxBurn]>0)+(ps.fx[FxPoison]>0), heal=(ps.fx[FxRegen]>0);
+    for(int k=0;k<FxCount;k++) ps.fx[k]=(int16_t)(ps.fx[k]-(ps.fx[k]>0));
+    st.hp=std::min(st.max_hp, st.hp+heal);
+    fx_refresh(ps);
+    return dmg;
+}
+
+// ---------------- Biomes ----------------
+static bool parse_biome(const std::string& s, Biome& b){
+    for(int i=0;i<kBiomeCount;i++) if(s==kBiomes[i].name){ b=(Biome)i; return true; }
+    return false;
+}
+
+// ---------------- Prototypes ----------------
+static Content builtin_content(){
+    Content c;
+    c.mons={{"You",'@'},{"Guardian",'B'},
+        {"rat",'r'},{"bat",'b'},{"kobold",'k'},{"goblin",'g'},{"orc",'o'},{"worm",'w'},{"snake",'s'},{"slime",'j'},
+        {"skeleton",'z'},{"zombie",'Z'},{"wolf",'d'},{"boar",'q'},{"imp",'i'},{"harpy",'H'},{"ghoul",'G'},{"shade",'W'},
+        {"spider",'x'},{"centipede",'c'},{"beetle",'a'},{"fungus",'F'},{"cultist",'p'},{"bandit",'p'},{"brigand",'p'},
+        {"thug",'p'},{"warlock",'h'},{"witch",'h'},{"acolyte",'p'},{"scout",'p'},{"archer",'p'},{"hound",'d'}};
+    using K=ItemKind;
+    c.items={
+        {K::PotionHeal,"potion of healing",'!',4,9,6,"Heals HP"},
+        {K::PotionStr,"potion of strength",'!',1,2,10,"Permanently +STR"},
+        {K::PotionAntidote,"potion of antidote",'!',0,0,6,"Cures poison"},
+        {K::PotionRegen,"potion of regeneration",'!',4,6,6,"Regenerates HP over time"},
+        {K::Key,"small key",';',1,1,5,"Opens locked chests"},
+        {K::SpellbookFirebolt,"spellbook: Firebolt",'?',0,0,25,"Learn: Firebolt"},
+        {K::SpellbookHeal,"spellbook: Heal",'?',0,0,25,"Learn: Heal"},
+        {K::SpellbookBlink,"spellbook: Blink",'?',0,0,25,"Learn: Blink"},
+        {K::SpellbookIce,"spellbook: Ice Shard",'?',0,0,25,"Learn: Ice Shard"},
+        {K::SpellbookShield,"spellbook: Shield",'?',0,0,25,"Learn: Shield"},
+        {K::SpellbookFireball,"spellbook: Fireball",'?',0,0,25,"Learn: Fireball"},
+        {K::ScrollBlink,"scroll of blink",'?',0,0,10,"Teleport a few tiles"},
+        {K::ScrollMapping,"scroll of mapping",'?',0,0,10,"Reveal the map"},
+        {K::Bomb,"bomb",'o',1,1,8,"Create an explosion"}};
+    for(const char* n: {"rusty dagger","bone dagger","steel dagger"}) c.items.push_back({K::Dagger,n,')',1,2,8,"Weapon",true});
+    for(const char* n: {"short sword","serrated sword","long sword","elven blade","orcish cleaver","rapier","falchion","gladius"}) c.items.push_back({K::Sword,n,')',2,4,15,"Weapon",true});
+    for(const char* n: {"ragged tunic","leather jerkin","studded leather"}) c.items.push_back({K::ArmorLeather,n,'[',1,2,12,"Armor",true});
+    for(const char* n: {"chain shirt","scale mail","lamellar","brigandine","elven mail","orcish hauberk","dwarf mail"}) c.items.push_back({K::ArmorChain,n,'[',2,4,20,"Armor",true});
+    c.loot={{K::PotionHeal,1},{K::PotionStr,1},{K::PotionAntidote,1},{K::PotionRegen,1},{K::Dagger,1},{K::Sword,1},
+        {K::ArmorLeather,1},{K::ArmorChain,1},{K::Key,2},{K::SpellbookFirebolt,1},{K::SpellbookHeal,1},{K::SpellbookBlink,1},
+        {K::SpellbookIce,1},{K::ScrollMapping,1},{K::Bomb,1},{K::SpellbookShield,2}};
+    for(int b=(int)Biome::Crypt;b<kBiomeCount;b++) c.biomes.push_back({(Biome)b,1});
+    c.index();
+    return c;
+}
+// The active tables. Replaced at most once, by install_content() during startup, before any Game exists.
+static Content& content_slot(){ static Content c=builtin_content(); return c; }
+const Content& content(){ return content_slot(); }
+void install_content(Content c){ c.index(); content_slot()=std::move(c); }
+
+// ---------------- Content packs ----------------
+static bool parse_item_kind(const std::string& s, ItemKind& k){
+    for(int i=0;i<kItemKindCount;i++) if(s==kItemKindNames[i]){ k=(ItemKind)i; return true; }
+    return false;
+}
+static std::string trim(const std::string& s){
+    size_t a=s.find_first_not_of(" \t\r"), b=s.find_last_not_of(" \t\r");
+    return a==std::string::npos? std::string() : s.substr(a,b-a+1);
+}
+// Cap on pack stat bonuses, so a rolled stat (and any damage built from it) stays far inside int16.
+constexpr int kMaxMonBonus=999;
+bool load_content_pack(const std::string& path, Content& out, std::string& err){
+    std::ifstream f(path);
+    if(!f){ err=path+": cannot open"; return false; }
+    Content pack; bool has_mons=false, has_items=false, has_loot=false, has_biomes=false, has_tips=false;
+    std::string line; int ln=0;
+    auto fail=[&](const std::string& m){ err=path+(ln>0? ":"+std::to_string(ln) : std::string())+": "+m; return false; };
+    while(std::getline(f,line)){
+        ln++;
+        size_t hash=line.find('#'); std::string body=trim(hash==std::string::npos? line : line.substr(0,hash));
+        if(body.empty()) continue;
+        std::istringstream in(body); std::string rec; in>>rec;
+        auto rest=[&]{ std::string r; std::getline(in,r); return trim(r); };
+        if(rec=="monster"){
+            MonsterProto m; std::string g;
+            if(!(in>>g>>m.hp>>m.atk>>m.def) || g.size()!=1) return fail("expected: monster <glyph> <hp> <atk> <def> <name>");
+            m.glyph=g[0]; m.name=rest();
+            if(m.name.empty()) return fail("monster needs a name");
+            // bonuses add to the level roll (make_mon), whose floor is hp 6, atk 1, def 0 on level 1
+            if(m.hp<-5 || m.hp>kMaxMonBonus) return fail("monster hp must be in -5.."+std::to_string(kMaxMonBonus));
+            if(m.atk<-1 || m.atk>kMaxMonBonus) return fail("monster atk must be in -1.."+std::to_string(kMaxMonBonus));
+            if(m.def<0 || m.def>kMaxMonBonus) return fail("monster def must be in 0.."+std::to_string(kMaxMonBonus));
+            pack.mons.push_back(std::move(m)); has_mons=true;
+        } else if(rec=="item"){
+            ItemProto it{}; std::string kind,g; int show=0;
+            if(!(in>>kind>>g>>it.power_lo>>it.power_hi>>it.price>>show) || g.size()!=1) return fail("expected: item <Kind> <glyph> <lo> <hi> <price> <0|1> <name> | <desc>");
+            if(!parse_item_kind(kind,it.kind)) return fail("unknown item kind '"+kind+"'");
+            if(it.power_lo>it.power_hi) return fail("power_lo > power_hi");
+            std::string r=rest(); size_t bar=r.find('|');
+            it.glyph=g[0]; it.desc_power=show!=0;
+            it.name=trim(r.substr(0,bar)); it.desc=bar==std::string::npos? std::string() : trim(r.substr(bar+1));
+            if(it.name.empty()) return fail("item needs a name");
+            pack.items.push_back(std::move(it)); has_items=true;
+        } else if(rec=="loot"){
+            std::string kind; LootEntry l{};
+            if(!(in>>kind>>l.weight)) return fail("expected: loot <Kind> <weight>");
+            if(!parse_item_kind(kind,l.kind)) return fail("unknown item kind '"+kind+"'");
+            if(l.weight<0) return fail("negative loot weight");
+            pack.loot.push_back(l); has_loot=true;
+        } else if(rec=="biome"){
+            BiomeEntry b{};
+            if(!(in>>b.weight) || b.weight<0) return fail("expected: biome <weight> <name>");
+            std::string name=rest(); if(!parse_biome(name,b.id)) return fail("unknown biome '"+name+"'");
+            pack.biomes.push_back(std::move(b)); has_biomes=true;
+        } else if(rec=="tip"){
+            std::string t=rest(); if(!t.empty()) pack.tips.push_back(std::move(t));
+            has_tips=true;
+        } else return fail("unknown record '"+rec+"'");
+    }
+    ln=0;
+    Content c=content();
+    if(has_mons){ c.mons.resize(MonFirstRandom); for(auto& m: pack.mons) c.mons.push_back(std::move(m)); } // player/guardian slots stay builtin
+    if(has_items) c.items=std::move(pack.items);
+    if(has_loot) c.loot=std::move(pack.loot);
+    if(has_biomes) c.biomes=std::move(pack.biomes);
+    if(has_tips) c.tips=std::move(pack.tips);
+    c.index();
+    // whole-pack checks: every roll must land on something
+    if(c.mons.size()<=MonFirstRandom) return fail("no monsters");
+    if(c.mons.size()>0xFFFF || c.items.size()>0xFFFF) return fail("too many prototypes");
+    if(c.loot_total<=0) return fail("loot weights sum to zero");
+    for(auto& l: c.loot) if(l.weight>0 && c.items_of_kind[(int)l.kind].empty()) return fail(std::string("loot kind ")+kItemKindNames[(int)l.kind]+" has no item");
+    if(c.items_of_kind[(int)ItemKind::Key].empty()) return fail("no Key item (merchants and chests need one)");
+    if(c.biome_total<=0) return fail("biome weights sum to zero");
+    if(c.mon_by_name.size()!=c.mons.size() || c.item_by_name.size()!=c.items.size()) return fail("duplicate prototype name");
+    out=std::move(c);
+    return true;
+}
+void dump_content(const Content& c, std::ostream& os){
+    os<<"# asciirogue content pack\n";
+    for(size_t i=MonFirstRandom;i<c.mons.size();i++){ auto& m=c.mons[i]; os<<"monster "<<m.glyph<<' '<<m.hp<<' '<<m.atk<<' '<<m.def<<' '<<m.name<<'\n'; }
+    for(auto& it: c.items) os<<"item "<<kItemKindNames[(int)it.kind]<<' '<<it.glyph<<' '<<it.power_lo<<' '<<it.power_hi<<' '<<it.price<<' '<<it.desc_power<<' '<<it.name<<" | "<<it.desc<<'\n';
+    for(auto& l: c.loot) os<<"loot "<<kItemKindNames[(int)l.kind]<<' '<<l.weight<<'\n';
+    for(auto& b: c.biomes) os<<"biome "<<b.weight<<' '<<biome_spec(b.id).name<<'\n';
+    for(auto& t: c.tips) os<<"tip "<<t<<'\n';
+}
+
+// ---------------- Game ----------------
+// Level switch: swap every level container for an empty one on the same arena, then hand the arena
+// back whole. Nothing may hold a pointer into the old level across this.
+void release_level(Game& g){
+    Arena* mr=g.level_mem.get();
+    g.ents=std::pmr::vector<Entity>(mr); g.events=std::pmr::vector<CombatEvent>(mr); g.status=StatusTable(mr);
+    g.grid=SpatialIndex(mr); g.fire=HazardLayer(mr);
+    mr->reset();
+    g.grid.reset(g.map.H,g.map.W); g.fire.reset(g.map.H,g.map.W);
+}
+
+// ---------------- Entity lifecycle ----------------
+// Entities are appended with increasing ids and compaction is stable, so g.ents stays sorted by id.
+Entity& spawn(Game& g, Entity e){ e.id=g.next_id++; g.ents.push_back(std::move(e)); g.grid.link((int)g.ents.size()-1,g.ents.back().pos); return g.ents.back(); }
+static void move_ent(Game& g, int i, Pos to){ g.grid.unlink(i,g.ents[i].pos); g.ents[i].pos=to; g.grid.link(i,to); }
+// credited: the kill counts for XP and the codex when the corpse is swept.
+static void kill_mob(Game& g, Entity& e, bool credited){ e.mob.alive=false; e.mob.slain=credited; g.ents_dirty=true; }
+static void consume(Game& g, Entity& e){ e.gone=true; g.ents_dirty=true; }
+// Once per turn: drop corpses and consumed entities, keeping order (and thus id order) intact.
+static void compact_entities(Game& g){
+    if(!g.ents_dirty) return;
+    for(auto& e: g.ents) g.grid.head[e.pos.r*g.grid.W+e.pos.c]=-1;
+    size_t w=0;
+    for(size_t i=0;i<g.ents.size();++i){
+        Entity& e=g.ents[i];
+        bool dead = e.type==EntityType::Mob && !e.mob.alive;
+        if(dead) g.kill_events.push_back({e.id,e.mob.proto,e.mob.xp,e.pos,e.mob.slain});
+        int row=e.mob.fx_row;
+        if(dead || e.gone){ if(row>=0) g.status.ent[row]=-1; continue; }
+        if(row>=0) g.status.ent[row]=(int)w;
+        if(w!=i) g.ents[w]=std::move(e);
+        ++w;
+    }
+    g.ents.resize(w); g.ents_dirty=false;
+    for(size_t j=0;j<g.status.size();){
+        if(g.status.ent[j]>=0){ ++j; continue; }
+        int moved=g.status.remove(j); if(moved>=0) g.ents[moved].mob.fx_row=(int)j;
+    }
+    for(size_t i=0;i<w;++i) g.grid.link((int)i,g.ents[i].pos);
+}
+// Row for mob i in g.status, added on its first affliction.
+static int status_row(Game& g, int i){ auto& m=g.ents[i].mob; if(m.fx_row<0) m.fx_row=g.status.add(i); return m.fx_row; }
+static void apply_kill_events(Game& g){
+    if(g.kills.size()<content().mons.size()) g.kills.resize(content().mons.size(),0);
+    for(auto& k: g.kill_events) if(k.credited){ g.kills[k.mon]++; grant_xp(g,k.xp); }
+    g.kill_events.clear();
+}
+
+// ---------------- Combat events ----------------
+static int ent_index(const Game& g, const Entity& e){ return &e==&g.player? -1 : (int)(&e-g.ents.data()); }
+void post(Game& g, const CombatEvent& ev){ g.events.push_back(ev); }
+static void resolve_events(Game& g){
+    for(const CombatEvent& ev: g.events){
+        Entity& t = ev.target<0? g.player : g.ents[ev.target];
+        if(ev.target>=0 && !t.mob.alive) continue; // already died earlier in this batch
+        if(ev.cause==Cause::Melee && ev.src>=0 && !g.ents[ev.src].mob.alive) continue; // nor do the dead strike
+        Stats& st=t.mob.st;
+        st.hp-=ev.dmg;
+        if(ev.burn|ev.snare|ev.poison){
+            if(ev.target<0){ auto& ps=g.pstat; ps.fx[FxBurn]+=ev.burn; ps.fx[FxSnare]+=ev.snare; ps.fx[FxPoison]+=ev.poison; fx_refresh(ps); }
+            else{ int j=status_row(g,ev.target); auto& fx=g.status.fx; fx[FxBurn][j]+=ev.burn; fx[FxSnare][j]+=ev.snare; fx[FxPoison][j]+=ev.poison; }
+        }
+        if(g.event_sink) g.event_sink(ev);
+        // names are views into content(), numbers fit in the small-string buffer: no allocation per hit
+        std::string_view tname = ev.target<0? std::string_view("You") : std::string_view(t.mob.name());
+        std::string dmg=std::to_string(ev.dmg);
+        switch(ev.cause){
+            case Cause::Melee: g.log.add({ev.src<0? std::string_view("You") : std::string_view(g.ents[ev.src].mob.name())," hit ",tname," for ",dmg,"."}); break;
+            case Cause::Explosion: if(ev.target<0) g.log.add({"You take ",dmg," explosive damage!"}); break;
+            case Cause::Firebolt: g.log.add({"Firebolt hits ",tname," for ",dmg,"!"}); break;
+            case Cause::IceShard: g.log.add({"Ice shard hits ",tname," (",dmg,")."}); break;
+            default: break;
+        }
+        if(ev.target<0 || st.hp>0) continue;
+        kill_mob(g,t, ev.cause!=Cause::Trap && ev.cause!=Cause::Ailment);
+        switch(ev.cause){
+            case Cause::Explosion: g.log.add({tname," is blown apart."}); break;
+            case Cause::Fireball: g.log.add({tname," is incinerated."}); break;
+            case Cause::Trap: case Cause::Ailment: g.log.add({tname," dies from ailments."}); break;
+            default: g.log.add({tname," dies."}); break;
+        }
+    }
+    g.events.clear();
+}
+
+// ---------------- Helpers ----------------
+char tile_glyph(const Cell& cell){
+    switch(cell.t){
+        case Tile::Wall: return '#';
+        case Tile::Floor: return '.';
+        case Tile::StairsDown: return '>';
+        case Tile::DoorClosed: return '+';
+        case Tile::DoorOpen: return '/';
+        case Tile::TrapHidden: return '.';
+        case Tile::TrapRevealed: return '.';
+        case Tile::SecretWall: return 'x'; // cracked wall
+        case Tile::Teleporter: return 'T';
+    }
+    return '?';
+}
+
+// ---------------- Gen helpers ----------------
+bool rect_overlap(const Rect&a,const Rect&b){ return !(a.r+a.h<=b.r || b.r+b.h<=a.r || a.c+a.w<=b.c || b.c+b.w<=a.c); }
+static void carve_room(Map&m,const Rect&R){ for(int r=R.r;r<R.r+R.h;r++) for(int c=R.c;c<R.c+R.w;c++) if(m.in(r,c)) m.at(r,c).t=Tile::Floor; }
+static void carve_h(Map&m,int r,int c1,int c2){ if(c2<c1) std::swap(c1,c2); for(int c=c1;c<=c2;c++) if(m.in(r,c)) m.at(r,c).t=Tile::Floor; }
+static void carve_v(Map&m,int c,int r1,int r2){ if(r2<r1) std::swap(r1,r2); for(int r=r1;r<=r2;r++) if(m.in(r,c)) m.at(r,c).t=Tile::Floor; }
+static Pos center(const Rect&R){ return {R.r+R.h/2, R.c+R.w/2}; }
+static bool is_door_site(const Map&m,int r,int c){
+    if(!m.in(r,c) || m.at(r,c).t!=Tile::Floor) return false;
+    int wallN=m.at(r-1,c).t==Tile::Wall, wallS=m.at(r+1,c).t==Tile::Wall;
+    int wallW=m.at(r,c-1).t==Tile::Wall, wallE=m.at(r,c+1).t==Tile::Wall;
+    if(wallN&&wallS && !wallW && !wallE) return true;
+    if(wallW&&wallE && !wallN && !wallS) return true;
+    return false;
+}
+
+// ---------------- Items/Monsters ----------------
+// Loot weights pick a kind, then one of that kind's prototypes; power is rolled from the prototype's range.
+Item make_random_item(RNG&rng){
+    const Content& C=content();
+    int roll=rng.i(0,C.loot_total-1); ItemKind kind=C.loot.back().kind;
+    for(auto& l: C.loot){ if(roll<l.weight){ kind=l.kind; break; } roll-=l.weight; }
+    const auto& ids=C.items_of_kind[(int)kind];
+    Item it{}; it.proto= ids.size()==1? ids[0] : ids[rng.i(0,(int)ids.size()-1)];
+    const ItemProto& p=it.data();
+    it.power= p.power_lo<p.power_hi? rng.i(p.power_lo,p.power_hi) : p.power_lo;
+    return it;
+}
+std::string item_desc(const Item& it){
+    const ItemProto& p=it.data();
+    return p.desc_power? p.desc+" +"+std::to_string(it.power) : p.desc;
+}
+Monster make_mon(RNG&rng,int level,Biome biome){
+    const Content& C=content(); const auto& cdf=C.mon_cdf[(int)biome];
+    uint32_t roll=(uint32_t)rng.i(0,(int)cdf.back()-1);
+    Monster m{}; m.proto=(uint16_t)(MonFirstRandom+(std::upper_bound(cdf.begin(),cdf.end(),roll)-cdf.begin()));
+    const MonsterProto& p=C.mons[m.proto];
+    m.st.max_hp=m.st.hp=rng.i(5+level, 10+level*2)+p.hp;
+    m.st.atk=rng.i(1+level/2, 3+level)+p.atk;
+ m.st.def=rng.i(0,2+level/2)+p.def;
+ m.st.str=rng.i(6,12+level);
+
+    m.ai=rng.chance(0.6)?AiKind::Hunter:AiKind::Wander; m.xp=4+level*2; m.speed= rng.i(70,130); m.energy=0; return m;
+}
+
+// ---------------- Generation ----------------
+static void place_doors(Map& m,RNG& rng){
+    for(int r=1;r<m.H-1;r++) for(int c=1;c<m.W-1;c++){ if(is_door_site(m,r,c) && rng.chance(0.35)) m.at(r,c).t=Tile::DoorClosed; }
+}
+static void carve_corridor(Map& m,RNG& rng,Pos a,Pos b){
+    if(rng.chance(0.5)){ carve_h(m,a.r,a.c,b.c); carve_v(m,b.c,a.r,b.r); } else { carve_v(m,a.c,a.r,b.r); carve_h(m,b.r,a.c,b.c); }
+}
+static std::vector<Rect> gen_rooms(Map& m,RNG& rng){
+    int rooms=rng.i(10,16); std::vector<Rect> R; int attempts=0; RoomHash hash(m.H,m.W);
+    while((int)R.size()<rooms && attempts<350){
+        attempts++; int h=rng.i(4,7), w=rng.i(5,11);
+ int r=rng.i(1,m.H-h-2), c=rng.i(1,m.W-w-2);
+
+        Rect t{r,c,h,w}; if(hash.overlaps(t,R)) continue; hash.add(t,(int)R.size()); R.push_back(t);
+    }
+    for(auto&q:R) carve_room(m,q);
+    std::vector<Pos> centers; for(auto&q:R) centers.push_back(center(q));
+    std::vector<int> order(centers.size());
+ for(size_t i=0;i<order.size();
+i++) order[i]=(int)i; std::shuffle(order.begin(),order.end(),rng.eng);
+
+    for(size_t i=1;i<order.size();
+i++) carve_corridor(m,rng,centers[order[i-1]],centers[order[i]]);
+    if(!R.empty()){ Pos s=center(R.back()); m.at(s.r,s.c).t=Tile::Teleporter; }
+    place_doors(m,rng);
+    return R;
+}
+// BSP levels: the interior is split until leaves are small, each leaf gets one room inset by a wall,
+// and every split joins one room from each side. Rooms cannot overlap, corridors follow the tree
+// (n-1 of them), and the room count grows with the map instead of being capped by retries.
+std::vector<Rect> gen_bsp(Map& m,RNG& rng){
+    constexpr int kLeafH=7, kLeafW=12;
+    struct Node{ Rect area; int kid[2]={-1,-1}; int room=-1; };
+    std::vector<Node> nodes{{Rect{1,1,m.H-2,m.W-2}}};
+    for(size_t i=0;i<nodes.size();i++){
+        Rect a=nodes[i].area;
+        bool can_r=a.h>=2*kLeafH, can_c=a.w>=2*kLeafW;
+        if(!can_r && !can_c) continue;
+        bool rows= can_r && (!can_c || (a.h*kLeafW>a.w*kLeafH? rng.chance(0.75) : rng.chance(0.25))); // favour cutting the long side
+        Rect p=a, q=a;
+        if(rows){ int k=rng.i(kLeafH,a.h-kLeafH); p.h=k; q.r+=k; q.h-=k; }
+        else    { int k=rng.i(kLeafW,a.w-kLeafW); p.w=k; q.c+=k; q.w-=k; }
+        nodes[i].kid[0]=(int)nodes.size(); nodes.push_back({p});
+        nodes[i].kid[1]=(int)nodes.size(); nodes.push_back({q});
+    }
+    std::vector<Rect> R;
+    for(auto& n: nodes) if(n.kid[0]<0){
+        const Rect& a=n.area;
+        int h=rng.i(4,std::min(7,a.h-2)), w=rng.i(5,std::min(11,a.w-2));
+        Rect t{a.r+1+rng.i(0,a.h-2-h), a.c+1+rng.i(0,a.w-2-w), h, w};
+        n.room=(int)R.size(); R.push_back(t); carve_room(m,t);
+    }
+    // children always come after their parent, so a reverse sweep sees both subtrees finished
+    for(size_t i=nodes.size(); i-->0;){
+        Node& n=nodes[i]; if(n.kid[0]<0) continue;
+        int a=nodes[n.kid[0]].room, b=nodes[n.kid[1]].room;
+        carve_corridor(m,rng,center(R[a]),center(R[b]));
+        n.room=rng.chance(0.5)? a : b;
+    }
+    if(!R.empty()){ Pos s=center(R.back()); m.at(s.r,s.c).t=Tile::Teleporter; }
+    place_doors(m,rng);
+    return R;
+}
+// Cave levels: cellular-automaton smoothing on bitboards, 64 cells per word, bit set = wall.
+// Each step counts the 3x3 neighbourhood for 64 cells at once with shifted words and a bit-sliced
+// adder, then a region pass drops specks and tunnels every remaining pocket into the main cave.
+static int ctz64(uint64_t x){
+#if defined(_MSC_VER)
+    unsigned long i; _BitScanForward64(&i,x); return (int)i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+// One 4-5 rule step: a cell is wall when at least 5 of the 9 cells around it (itself included) are.
+void ca_step(const Bitboard& in, Bitboard& out){
+    const int NW=in.NW; const uint64_t kAll=~0ULL;
+    auto maj=[](uint64_t a,uint64_t b,uint64_t c){ return (a&b)|(a&c)|(b&c); };
+    for(int r=1;r<in.H-1;r++){
+        const uint64_t* rows[3]={in.row(r-1),in.row(r),in.row(r+1)};
+        uint64_t* o=out.row(r);
+        for(int k=0;k<NW;k++){
+            uint64_t lo[3],hi[3]; // per source row: 2-bit count of its three cells
+            for(int j=0;j<3;j++){
+                const uint64_t* q=rows[j];
+                uint64_t c=q[k], prev=k>0? q[k-1] : kAll, next=k+1<NW? q[k+1] : kAll;
+                uint64_t L=(c<<1)|(prev>>63), R=(c>>1)|(next<<63); // column c-1 / c+1 moved onto bit c
+                lo[j]=L^c^R; hi[j]=maj(L,c,R);
+            }
+            uint64_t ones=lo[0]^lo[1]^lo[2], k2=maj(lo[0],lo[1],lo[2]);
+            uint64_t t0=hi[0]^hi[1]^hi[2], t1=maj(hi[0],hi[1],hi[2]);
+            uint64_t twos=t0^k2, c4=t0&k2, fours=t1^c4, eights=t1&c4;
+            o[k]=eights|(fours&(twos|ones));
+        }
+    }
+    out.wall_border();
+}
+std::vector<Rect> gen_caves(Map& m,RNG& rng){
+    Bitboard a(m.H,m.W), b(m.H,m.W);
+    FastRNG fr{rng.eng()};
+    for(auto& x: a.w){ uint64_t p=fr.next(), q=fr.next(), u=fr.next(), v=fr.next(); x=(p&q)|(u&v); } // 7/16 walls
+    a.wall_border();
+    for(int i=0;i<5;i++){ ca_step(a,b); std::swap(a,b); }
+
+    // regions of floor by flood fill; seeds come from scanning the inverted words
+    std::vector<int> label((size_t)m.H*m.W,-1), stack; std::vector<int> size, rep;
+    for(int r=1;r<m.H-1;r++) for(int k=0;k<a.NW;k++){
+        uint64_t open=~a.row(r)[k]&(k+1==a.NW? a.tail() : ~0ULL);
+        while(open){
+            int c=(k<<6)+ctz64(open); open&=open-1;
+            if(label[(size_t)r*m.W+c]>=0) continue;
+            int id=(int)size.size(), n=0; size.push_back(0); rep.push_back(r*m.W+c);
+            label[(size_t)r*m.W+c]=id; stack.push_back(r*m.W+c);
+            while(!stack.empty()){
+                int v=stack.back(); stack.pop_back(); n++;
+                int vr=v/m.W, vc=v%m.W;
+                const int nb[4]={v-m.W,v+m.W,v-1,v+1}, nr[4]={vr-1,vr+1,vr,vr}, nc[4]={vc,vc,vc-1,vc+1};
+                for(int d=0;d<4;d++) if(!a.get(nr[d],nc[d]) && label[nb[d]]<0){ label[nb[d]]=id; stack.push_back(nb[d]); }
+            }
+            size[id]=n;
+        }
+    }
+    const int kMinRegion=12;
+    int main_id=-1; for(int i=0;i<(int)size.size();i++) if(main_id<0 || size[i]>size[main_id]) main_id=i;
+    for(int r=0;r<m.H;r++) for(int c=0;c<m.W;c++){ int l=label[(size_t)r*m.W+c]; if(l>=0 && size[l]>=kMinRegion) m.at(r,c).t=Tile::Floor; }
+    if(main_id<0){ Rect R{m.H/2-1,m.W/2-1,3,3}; carve_room(m,R); return {R}; } // all rock: leave one chamber
+    // join each pocket to the nearest already-joined one
+    std::vector<Pos> joined{{rep[main_id]/m.W,rep[main_id]%m.W}};
+    for(int i=0;i<(int)size.size();i++){
+        if(i==main_id || size[i]<kMinRegion) continue;
+        Pos p{rep[i]/m.W,rep[i]%m.W}, best=joined[0]; int bd=INT32_MAX;
+        for(auto& q: joined){ int d=std::abs(q.r-p.r)+std::abs(q.c-p.c); if(d<bd){ bd=d; best=q; } }
+        if(rng.chance(0.5)){ carve_h(m,p.r,p.c,best.c); carve_v(m,best.c,p.r,best.r); } else { carve_v(m,p.c,p.r,best.r); carve_h(m,best.r,p.c,best.c); }
+        joined.push_back(p);
+    }
+    // anchors stand in for room centres: spawns, the player start, and the teleporter on the last one.
+    // Each keeps clear of the start and of the anchors before it, so spawns never stack or land on the player.
+    constexpr int kStartClear=4, kAnchorGap=2; // Chebyshev distances
+    int want=rng.i(10,16); std::vector<Rect> R;
+    R.push_back({joined[0].r-1,joined[0].c-1,3,3});
+    for(int tries=0;(int)R.size()<want && tries<want*200;tries++){
+        int r=rng.i(1,m.H-2), c=rng.i(1,m.W-2);
+        if(m.at(r,c).t!=Tile::Floor) continue;
+        bool clear=true;
+        for(size_t k=0;k<R.size() && clear;k++){
+            Pos q=center(R[k]); int d=std::max(std::abs(q.r-r),std::abs(q.c-c));
+            clear= d>=(k==0? kStartClear : kAnchorGap);
+        }
+        if(clear) R.push_back({r-1,c-1,3,3});
+    }
+    if(R.size()>1){ Pos s=center(R.back()); m.at(s.r,s.c).t=Tile::Teleporter; }
+    return R;
+}
+std::vector<Rect> generate_dungeon(Map& m,RNG& rng,Biome& biome){
+    m.clear();
+    const Content& C=content();
+    int roll=rng.i(0,C.biome_total-1); size_t bi=0;
+    while(roll>=C.biomes[bi].weight){ roll-=C.biomes[bi].weight; bi++; }
+    biome=C.biomes[bi].id;
+    const BiomeSpec& spec=biome_spec(biome);
+    std::vector<Rect> R;
+    switch(spec.gen){
+        case LevelGen::Rooms: R=gen_rooms(m,rng); break;
+        case LevelGen::Caves: R=gen_caves(m,rng); break;
+        case LevelGen::Bsp: R=gen_bsp(m,rng); break;
+    }
+    for(int r=1;r<m.H-1;r++) for(int c=1;c<m.W-1;c++){ if(m.at(r,c).t==Tile::Floor && rng.chance(spec.trap_rate)) m.at(r,c).t=Tile::TrapHidden; }
+    return R;
+}
+static void place_player(Game& g,const std::vector<Rect>& rooms){ g.player.pos=rooms.empty()? Pos{1,1}: center(rooms.front()); }
+static void place_mobs_items_chests(Game& g,const std::vector<Rect>& rooms){
+    for(size_t i=1;i<rooms.size();i++){
+        Pos p=center(rooms[i]);
+        if(g.rng.chance(0.80)){ Entity e{}; e.type=EntityType::Mob; e.pos=p; e.mob=make_mon(g.rng,g.level,g.biome);
+ spawn(g,e);
+ }
+        if(g.rng.chance(0.65)){ Entity it{}; it.type=EntityType::ItemEntity; it.blocks=false; it.pos={p.r+g.rng.i(-1,1), p.c+g.rng.i(-1,1)}; if(!g.map.in(it.pos.r,it.pos.c)||!g.map.walkable(it.pos.r,it.pos.c)) it.pos=p; it.item=make_random_item(g.rng);
+ spawn(g,it);
+ }
+        if(g.rng.chance(0.45)){ Entity ch{}; ch.type=EntityType::Chest; ch.blocks=false; ch.pos=p; ch.chest.locked=g.rng.chance(0.65);
+ ch.chest.opened=false; ch.chest.content=make_random_item(g.rng);
+ spawn(g,ch);
+ }
+    }
+}
+
+// ---------------- Combat/Status ----------------
+static int roll_damage(RNG&rng,int atk,int def){ int base=std::max(0,atk-def);
+ int var=rng.i(0,2);
+ return std::max(0,base+var);
+ }
+void process_statuses(Game& g){
+    prof::Scope prof_scope(prof::Statuses);
+    auto& ps=g.pstat;
+    if(ps.mask){
+        if(ps.fx[FxBurn]>0) g.log.add("You are burning!");
+        if(ps.fx[FxPoison]>0) g.log.add("You suffer poison.");
+        if(ps.fx[FxRegen]>0) g.log.add("You regenerate.");
+        if(int dmg=fx_tick(ps,g.player.mob.st)) post(g,{-1,-1,(int16_t)dmg,0,0,0,Cause::Ailment});
+        if(!ps.fx[FxShield]) ps.shield_bonus=0;
+    }
+    // only afflicted mobs; rows whose timers ran out (or whose mob died) drop out by swap-remove
+    auto& T=g.status;
+    for(size_t j=0;j<T.size();){
+        const auto& m=g.ents[T.ent[j]].mob;
+        if(!m.alive || !T.any(j)){ g.ents[T.ent[j]].mob.fx_row=-1; int moved=T.remove(j); if(moved>=0) g.ents[moved].mob.fx_row=(int)j; continue; }
+        T.live[j]=m.dormant_since<0; ++j;
+    }
+    // the tick itself: straight-line passes down each column, dormant rows masked out by live
+    const size_t n=T.size(); ScratchScope sc;
+    std::pmr::vector<int16_t> dmg(n,0,*sc), heal(n,0,*sc);
+    const int16_t *live=T.live.data(), *burn=T.fx[FxBurn].data(), *poison=T.fx[FxPoison].data(), *regen=T.fx[FxRegen].data();
+    for(size_t j=0;j<n;j++){ dmg[j]=(int16_t)(live[j]*((burn[j]>0)+(poison[j]>0))); heal[j]=(int16_t)(live[j]*(regen[j]>0)); }
+    for(auto& col: T.fx){ int16_t* c=col.data(); for(size_t j=0;j<n;j++) c[j]=(int16_t)(c[j]-live[j]*(c[j]>0)); }
+    for(size_t j=0;j<n;j++){
+        if(!(dmg[j]|heal[j])) continue;
+        int i=T.ent[j]; auto& st=g.ents[i].mob.st;
+        st.hp=std::min(st.max_hp, st.hp+heal[j]);
+        if(dmg[j]) post(g,{i,-1,dmg[j],0,0,0,Cause::Ailment});
+    }
+    resolve_events(g);
+}
+static void grant_xp(Game& g,int amt){ g.xp += amt; g.log.add("You gain "+std::to_string(amt)+" XP."); level_up(g); }
+int xp_to_next(int plv){ return 10 + plv*10; }
+static void level_up(Game& g){
+    while(g.xp >= xp_to_next(g.plv)){
+        g.xp -= xp_to_next(g.plv); g.plv++;
+        g.player.mob.st.max_hp += 2; g.player.mob.st.hp = g.player.mob.st.max_hp;
+        g.player.mob.st.atk += 1; g.player.mob.st.max_mp += 1; g.player.mob.st.mp = g.player.mob.st.max_mp;
+        g.log.add("Level up! You are now level "+std::to_string(g.plv)+".");
+        // 25% chance to learn a random spell
+        if(g.rng.chance(0.25)){
+            SpellKind s = (SpellKind)g.rng.i(0,4);
+            if(!g.inv.knows(s)){ g.inv.learn(s);
+ g.log.add("You intuit a new spell.");
+ }
+        }
+    }
+}
+static void attack(Game& g, Entity& A, Entity& B){
+    int atk = A.mob.st.atk;
+    int def = B.mob.st.def;
+    // player weapon bonus
+    if(A.type==EntityType::Player && g.inv.weapon_idx>=0 && g.inv.weapon_idx<(int)g.inv.items.size()){
+        const Item& w = g.inv.items[g.inv.weapon_idx];
+        if(w.kind()==ItemKind::Dagger) atk += 2;
+        if(w.kind()==ItemKind::Sword) atk += 4;
+    }
+    // armor reduces damage passively (already in def), but if player has armor equipped, increase def
+    if(B.type==EntityType::Player && g.inv.armor_idx>=0 && g.inv.armor_idx<(int)g.inv.items.size()){
+        const Item& ar = g.inv.items[g.inv.armor_idx];
+        if(ar.kind()==ItemKind::ArmorLeather) def += 1;
+        if(ar.kind()==ItemKind::ArmorChain) def += 2;
+    }
+    int dmg = std::max(1, atk - def + g.rng.i(0,2));
+    post(g,{ent_index(g,B),ent_index(g,A),(int16_t)dmg,0,0,0,Cause::Melee});
+}
+
+// ---------------- Inventory ----------------
+void pickup(Game& g){
+    for(size_t i=0;i<g.ents.size();++i){
+        auto&e=g.ents[i];
+        if(e.type==EntityType::ItemEntity && !e.gone && e.pos==g.player.pos){
+            if(e.item.kind()==ItemKind::Key && g.opt.auto_pickup_keys){ g.inv.keys++; g.log.add("Picked up a key.");
+ consume(g,e);
+ return; }
+            g.inv.items.push_back(e.item);
+ g.log.add("Picked up: "+e.item.name()+" ("+item_desc(e.item)+")");
+ consume(g,e);
+ return;
+        }
+    } g.log.add("Nothing here to pick up.");
+}
+void use_item(Game& g,int idx){
+    if(idx<0||idx>=(int)g.inv.items.size()) return; auto it=g.inv.items[idx];
+    switch(it.kind()){
+        case ItemKind::PotionHeal:{ int before=g.player.mob.st.hp; g.player.mob.st.hp=std::min(g.player.mob.st.max_hp,g.player.mob.st.hp+it.power);
+ g.log.add("You heal "+std::to_string(g.player.mob.st.hp-before)+" HP.");
+ g.inv.items.erase(g.inv.items.begin()+idx);
+ if(g.inv.weapon_idx==idx) g.inv.weapon_idx=-1; if(g.inv.armor_idx==idx) g.inv.armor_idx=-1; }break;
+        case ItemKind::PotionStr:{ g.player.mob.st.str+=it.power; g.player.mob.st.atk+=it.power/2; g.player.mob.st.max_hp+=it.power; g.player.mob.st.hp=std::min(g.player.mob.st.hp+it.power,g.player.mob.st.max_hp);
+ g.log.add("You feel stronger!");
+ g.inv.items.erase(g.inv.items.begin()+idx);
+ if(g.inv.weapon_idx==idx) g.inv.weapon_idx=-1; if(g.inv.armor_idx==idx) g.inv.armor_idx=-1; }break;
+        case ItemKind::PotionAntidote:{ fx_set(g.pstat,FxPoison,0); g.log.add("Poison cured.");
+ g.inv.items.erase(g.inv.items.begin()+idx);
+ }break;
+        case ItemKind::PotionRegen:{ fx_add(g.pstat,FxRegen,it.power); g.log.add("You begin regenerating.");
+ g.inv.items.erase(g.inv.items.begin()+idx);
+ }break;
+        case ItemKind::Dagger: case ItemKind::Sword:{ g.inv.weapon_idx=idx; g.log.add("You wield: "+it.name()+" (+"+std::to_string(it.power)+")"); }break;
+        case ItemKind::ArmorLeather: case ItemKind::ArmorChain:{ g.inv.armor_idx=idx; g.log.add("You don: "+it.name()+" (+"+std::to_string(it.power)+")"); }break;
+        case ItemKind::Key:{ g.log.add("A key. Use it on a chest with 'o'."); }break;
+        case ItemKind::Bomb:{
+            // place a timed bomb on the ground (fuse 2 turns)
+            Entity b{}; b.type=EntityType::BombPlaced; b.blocks=false; b.pos=g.player.pos; b.fuse=2;
+            spawn(g,b);
+            g.inv.items.erase(g.inv.items.begin()+idx);
+            if(g.inv.weapon_idx==idx) g.inv.weapon_idx=-1;
+            if(g.inv.armor_idx==idx) g.inv.armor_idx=-1;
+        }break;
+        case ItemKind::ScrollMapping:{
+            // First, mark all non-wall tiles as seen, including teleporter and entities' tiles
+            for(int r=0;r<g.map.H;r++){
+                for(int c=0;c<g.map.W;c++){
+                    if(!g.map.in(r,c)) continue;
+                    Tile t = g.map.at(r,c).t;
+                    bool nonwall = (t!=Tile::Wall && t!=Tile::SecretWall);
+                    if(nonwall) g.map.at(r,c).seen = true;
+                }
+            }
+            // Also mark chests and items' tiles as seen
+            for(const auto& e: g.ents){
+                if(e.type==EntityType::Chest || e.type==EntityType::ItemEntity || e.type==EntityType::Merchant){
+                    g.map.at(e.pos.r,e.pos.c).seen = true;
+                }
+            }
+            // Second, mark walls as seen only if adjacent to a seen non-wall tile
+            for(int r=0;r<g.map.H;r++){
+                for(int c=0;c<g.map.W;c++){
+                    if(!g.map.in(r,c)) continue;
+                    if(g.map.at(r,c).t==Tile::Wall || g.map.at(r,c).t==Tile::SecretWall){
+                        bool adj=false;
+                        const int dr[4]={-1,1,0,0}, dc[4]={0,0,-1,1};
+                        for(int k=0;k<4;k++){
+                            int rr=r+dr[k], cc=c+dc[k];
+                            if(g.map.in(rr,cc) && g.map.at(rr,cc).seen && g.map.at(rr,cc).t!=Tile::Wall && g.map.at(rr,cc).t!=Tile::SecretWall){ adj=true; break; }
+                        }
+                        if(adj) g.map.at(r,c).seen = true;
+                    }
+                }
+            }
+            g.log.add("You unfurl the map. The layout and the portal are revealed.");
+            g.inv.items.erase(g.inv.items.begin()+idx);
+            if(g.inv.weapon_idx==idx) g.inv.weapon_idx=-1;
+            if(g.inv.armor_idx==idx) g.inv.armor_idx=-1;
+        }break;
+        case ItemKind::SpellbookFirebolt:{ g.inv.learn(SpellKind::Firebolt);
+ g.log.add("Learned Firebolt.");
+ g.inv.items.erase(g.inv.items.begin()+idx);
+ }break;
+        case ItemKind::SpellbookHeal:{ g.inv.learn(SpellKind::Heal);
+ g.log.add("Learned Heal.");
+ g.inv.items.erase(g.inv.items.begin()+idx);
+ }break;
+        case ItemKind::SpellbookBlink:{ g.inv.learn(SpellKind::Blink);
+ g.log.add("Learned Blink.");
+ g.inv.items.erase(g.inv.items.begin()+idx);
+ }break;
+        case ItemKind::SpellbookIce:{ g.inv.learn(SpellKind::IceShard);
+ g.log.add("Learned Ice Shard.");
+ g.inv.items.erase(g.inv.items.begin()+idx);
+ }break;
+        case ItemKind::SpellbookShield:{ g.inv.learn(SpellKind::Shield);
+ g.log.add("Learned Shield.");
+ g.inv.items.erase(g.inv.items.begin()+idx);
+ }break;
+        case ItemKind::ScrollBlink:{
+            std::vector<Pos> spots; for(int r=0;r<g.map.H;r++) for(int c=0;c<g.map.W;c++) if(g.map.at(r,c).visible && g.map.walkable(r,c) && !(g.player.pos.r==r && g.player.pos.c==c)) spots.push_back({r,c});
+            if(spots.empty()) g.log.add("Blink fails.");
+ else { g.player.pos=spots[g.rng.i(0,(int)spots.size()-1)]; g.log.add("You blink.");
+ }
+            g.inv.items.erase(g.inv.items.begin()+idx); if(g.inv.weapon_idx==idx) g.inv.weapon_idx=-1; if(g.inv.armor_idx==idx) g.inv.armor_idx=-1;
+        }break;
+    }
+}
+void drop_item(Game& g,int idx){
+
+    if(idx<0 || idx>=(int)g.inv.items.size()) return;
+    Item it = g.inv.items[idx];
+    // can't drop onto teleporter or chest occupied tile (also checked by caller)
+    for(auto& e: g.ents){
+        if(e.pos==g.player.pos && (e.type==EntityType::Chest)){ g.log.add("Can't drop here."); return; }
+    }
+    Entity ent{}; ent.type=EntityType::ItemEntity; ent.blocks=false; ent.pos=g.player.pos; ent.item=it;
+    spawn(g,ent);
+    g.inv.items.erase(g.inv.items.begin()+idx);
+    if(g.inv.weapon_idx==idx) g.inv.weapon_idx=-1;
+    if(g.inv.armor_idx==idx) g.inv.armor_idx=-1;
+    if(g.inv.weapon_idx>idx) g.inv.weapon_idx--;
+    if(g.inv.armor_idx>idx) g.inv.armor_idx--;
+    g.log.add("Dropped "+it.name()+".");
+
+}
+
+// ---------------- Doors/Traps/Chests ----------------
+bool is_closed_door(const Map&m,int r,int c){ return m.in(r,c) && m.at(r,c).t==Tile::DoorClosed; }
+static void open_door(Game& g,int r,int c){ if(is_closed_door(g.map,r,c)){ g.map.at(r,c).t=Tile::DoorOpen; g.log.add("You open the door."); } }
+static TrapKind trap_kind_for_biome(Biome biome,RNG&rng){
+    const BiomeSpec& s=biome_spec(biome);
+    return rng.chance(s.p_trap_a)? s.trap_a : s.trap_b;
+}
+// One blast over the whole area; square=true is a Chebyshev box (bombs), otherwise a Manhattan diamond.
+static void explode_at(Game& g, int r, int c, int radius, bool square){
+    g.log.add("An explosion rocks the dungeon!");
+    int dr=std::abs(g.player.pos.r-r), dc=std::abs(g.player.pos.c-c);
+    if(square? std::max(dr,dc)<=radius : dr+dc<=radius) post(g,{-1,-1,(int16_t)g.rng.i(2,6),0,0,0,Cause::Explosion});
+    for_each_in_area(g,{r,c},radius,square,[&](int i){ const auto& e=g.ents[i];
+        if(e.type==EntityType::Mob && e.mob.alive) post(g,{i,-1,(int16_t)g.rng.i(3,8),0,0,0,Cause::Explosion}); });
+    int crack = square? radius+1 : 1; // secret walls crumble next to any blasted cell
+    for(int rr=r-crack; rr<=r+crack; ++rr) for(int cc=c-crack; cc<=c+crack; ++cc){ if(g.map.in(rr,cc) && g.map.at(rr,cc).t==Tile::SecretWall){ g.map.at(rr,cc).t = Tile::DoorOpen; g.map.at(rr,cc).seen=true; g.log.add("A secret wall crumbles!"); } }
+}
+static void trigger_trap(Game& g,int r,int c){
+    g.map.at(r,c).t=Tile::TrapRevealed;
+    TrapKind tk=trap_kind_for_biome(g.biome,g.rng);
+    switch(tk){
+        case TrapKind::Spike:{ int dmg=g.rng.i(2,6);
+ g.player.mob.st.hp-=dmg; g.log.add("A spike trap! You take "+std::to_string(dmg)+" damage.");
+ }break;
+        case TrapKind::Fire:{ fx_add(g.pstat,FxBurn,3); g.log.add("A fire trap! You are burning."); }break;
+        case TrapKind::Snare:{ fx_add(g.pstat,FxSnare,2); g.log.add("A snare! You're entangled."); }break;
+        case TrapKind::Poison:{ fx_add(g.pstat,FxPoison,4); g.log.add("Poison darts! You are poisoned."); }break;
+        case TrapKind::Teleport:{ std::vector<Pos> spots; for(int rr=0;rr<g.map.H;rr++) for(int cc=0;cc<g.map.W;cc++) if(g.map.walkable(rr,cc)) spots.push_back({rr,cc});
+ if(!spots.empty()){ g.player.pos = spots[g.rng.i(0,(int)spots.size()-1)]; g.log.add("A teleport trap warps you!");
+ } }break;
+        case TrapKind::Explosive:{ explode_at(g,r,c,2); }break;
+    }
+}
+static void trigger_trap_on_entity(Game& g, Entity& e, int r, int c){
+    g.map.at(r,c).t=Tile::TrapRevealed;
+    TrapKind tk=trap_kind_for_biome(g.biome,g.rng); int idx=ent_index(g,e);
+    switch(tk){
+        case TrapKind::Spike:{ post(g,{idx,-1,(int16_t)g.rng.i(2,6),0,0,0,Cause::Trap}); }break;
+        case TrapKind::Fire:{ post(g,{idx,-1,0,3,0,0,Cause::Trap}); }break;
+        case TrapKind::Snare:{ post(g,{idx,-1,0,0,2,0,Cause::Trap}); }break;
+        case TrapKind::Poison:{ post(g,{idx,-1,0,0,0,4,Cause::Trap}); }break;
+        case TrapKind::Teleport:{ std::vector<Pos> spots; for(int rr=0;rr<g.map.H;rr++) for(int cc=0;cc<g.map.W;cc++) if(g.map.walkable(rr,cc)) spots.push_back({rr,cc}); if(!spots.empty()){ move_ent(g,idx,spots[g.rng.i(0,(int)spots.size()-1)]); } }break;
+        case TrapKind::Explosive:{ explode_at(g,r,c,2); }break;
+    }
+}
+static void open_chest(Game& g){
+    for(size_t i=0;i<g.ents.size();++i){
+        auto&e=g.ents[i]; if(e.type==EntityType::Chest && e.pos==g.player.pos){
+            if(e.chest.opened){ g.log.add("The chest is empty."); return; }
+            if(e.chest.locked){ if(g.inv.keys>0){ g.inv.keys--; e.chest.locked=false; g.log.add("You unlock the chest.");
+ } else { g.log.add("Locked. You need a key.");
+ return; } }
+            e.chest.opened=true; Entity it{}; it.type=EntityType::ItemEntity; it.blocks=false; it.pos=e.pos; it.item=e.chest.content; spawn(g,it);
+ g.log.add("You open the chest.");
+ return;
+        }
+    } g.log.add("No chest here.");
+}
+void try_open_adjacent(Game& g){
+    for(Pos d: kDir4){ Pos nb{g.player.pos.r+d.r,g.player.pos.c+d.c}; if(is_closed_door(g.map,nb.r,nb.c)){ open_door(g,nb.r,nb.c); return; } }
+    open_chest(g);
+}
+void search(Game& g){
+    int found=0;
+    for(Pos d: kDir4){ Pos nb{g.player.pos.r+d.r,g.player.pos.c+d.c};
+        if(g.map.in(nb.r,nb.c) && g.map.at(nb.r,nb.c).t==Tile::TrapHidden && g.rng.chance(0.5)){ g.map.at(nb.r,nb.c).t=Tile::TrapRevealed; found++; }
+        if(is_closed_door(g.map,nb.r,nb.c) && g.rng.chance(0.25)){ g.log.add("You listen at a door."); }
+    }
+    if(found>0) g.log.add("You discover "+std::to_string(found)+" trap(s)!");
+ else g.log.add("You find nothing.");
+
+}
+
+// ---------------- Terminal colors ----------------
+TermColors& term_colors(){ static TermColors t; return t; }
+const std::string& color_code(Color c){ return term_colors().sgr[(int)c]; }
+// NO_COLOR, then COLORTERM, then TERM; 16 colors when nothing better is advertised.
+ColorMode detect_color_mode(){
+    auto env=[](const char* k){ const char* v=std::getenv(k); return std::string(v? v : ""); };
+    if(!env("NO_COLOR").empty()) return ColorMode::Mono;
+    std::string ct=env("COLORTERM"), term=env("TERM");
+    if(ct=="truecolor" || ct=="24bit") return ColorMode::TrueColor;
+    if(term=="dumb") return ColorMode::Mono;
+    // consoles that only know the 16 base colors; anything else (xterm, screen, tmux, unset) keeps 256
+    if(term=="linux" || term.rfind("vt",0)==0 || term.rfind("cons",0)==0 || term.find("16color")!=std::string::npos) return ColorMode::Ansi16;
+    return ColorMode::Ansi256;
+}
+bool parse_color_mode(const std::string& s, ColorMode& out){
+    if(s=="mono"||s=="none") out=ColorMode::Mono;
+    else if(s=="16") out=ColorMode::Ansi16;
+    else if(s=="256") out=ColorMode::Ansi256;
+    else if(s=="truecolor"||s=="24bit") out=ColorMode::TrueColor;
+    else return false;
+    return true;
+}
+
+// ---------------- Rendering ----------------
+static bool occupied(const Game& g,int r,int c){
+    if(g.player.pos.r==r && g.player.pos.c==c) return true;
+    if(!g.map.in(r,c)) return false;
+    for(int i=g.grid.first(r,c); i!=-1; i=g.grid.next[i]){ auto& e=g.ents[i]; if(e.type!=EntityType::ItemEntity && e.mob.alive && e.blocks && !e.gone) return true; }
+    return false;
+}
+static int mob_index_at(const Game& g,int r,int c){ return index_at(g,r,c,[](const Entity& e){ return e.type==EntityType::Mob && e.mob.alive; }); }
+static Entity* mob_at(Game& g,int r,int c){ int i=mob_index_at(g,r,c); return i<0? nullptr : &g.ents[i]; }
+static Entity* chest_at(Game& g,int r,int c){ int i=index_at(g,r,c,[](const Entity& e){ return e.type==EntityType::Chest; }); return i<0? nullptr : &g.ents[i]; }
+static Entity* item_at(Game& g,int r,int c){ int i=index_at(g,r,c,[](const Entity& e){ return e.type==EntityType::ItemEntity; }); return i<0? nullptr : &g.ents[i]; }
+static void draw_hud(const Game& g,std::ostream& os=std::cout){
+
+    int armor=(g.inv.armor_idx>=0 && g.inv.armor_idx<(int)g.inv.items.size())? g.inv.items[g.inv.armor_idx].power:0;
+    int def_total = g.player.mob.st.def + armor + g.pstat.shield_bonus;
+
+    std::ostringstream left, right;
+    right<<" PLv "<<g.plv<<" XP "<<g.xp<<"/"<<xp_to_next(g.plv);
+
+    // bomb indicator if on player's tile
+    for(const auto& e: g.ents){
+        if(e.type==EntityType::BombPlaced && e.pos.r==g.player.pos.r && e.pos.c==g.player.pos.c){
+            right<<" Bomb:"<<e.fuse;
+            break;
+        }
+    }
+
+    left<<"H "<<g.player.mob.st.hp<<"/"<<g.player.mob.st.max_hp
+        <<" M "<<g.player.mob.st.mp<<"/"<<g.player.mob.st.max_mp
+        <<" A "<<g.player.mob.st.atk
+        <<" D "<<def_total
+        <<" K: "<<g.inv.keys
+        <<" L "<<g.level<<"/"<<g.max_level;
+
+    std::string l=left.str(), r=right.str();
+    int W=g.scr_w;
+    int mid = W - (int)r.size();
+    if(mid<1) mid=1;
+    if((int)l.size()>mid) l.resize(mid);
+    std::string row = l + r;
+
+    io::move(g.scr_h-4,0,os);
+    os<< std::left << std::setw(W) << row;
+
+    // second line: biome + help
+    io::move(g.scr_h-3,0,os);
+    std::string help = " (i)nven (g)get (s)earch (o)pen (z)cast (m)ap (X)codex (c)har (O)ptions (>)down (?)help (t)trade (q)save+quit";
+    std::string line2 = std::string("[")+biome_spec(g.biome).name+"]"+help;
+    if((int)line2.size()>W) line2.resize(W);
+    os<< std::left << std::setw(W) << line2;
+
+}
+
+// ---------------- Frames ----------------
+int view_h(const Game& g){ return g.scr_h-kHudRows; }
+int view_w(const Game& g){ return g.scr_w-kLegendW; }
+bool screen_too_small(const Game& g){ return g.scr_h<kHudRows+8 || g.scr_w<kLegendW+20; }
+static void tile_look(const Cell& cell, const BiomeSpec& b, char& ch, Color& co){
+    ch=' '; co=Color::Default;
+    if(cell.visible){
+        ch=tile_glyph(cell);
+        switch(cell.t){
+            case Tile::Wall: co=b.wall; break;
+            case Tile::Floor: co=b.floor; break;
+            case Tile::StairsDown: co=Color::Stairs; break;
+            case Tile::DoorClosed: case Tile::DoorOpen: co=Color::Door; break;
+            case Tile::TrapRevealed: co=Color::Trap; break;
+            case Tile::TrapHidden: co=Color::Trap; break;
+            case Tile::SecretWall: co=b.wall; break;
+            case Tile::Teleporter: co=Color::Teleporter; break;
+        }
+    } else if(cell.seen){
+        ch=(tile_glyph(cell)=='#'?'#':',');
+        co=Color::Legend;
+    }
+}
+// Bring the cached looks up to date for the h x w window at (r0,c0).
+static void refresh_tiles(TileLayer& L, const Map& m, Biome biome, int r0, int c0, int h, int w){
+    const BiomeSpec& spec=biome_spec(biome);
+    size_t n=(size_t)m.H*m.W;
+    if(L.W!=m.W || L.key.size()!=n || L.biome!=biome){ L.W=m.W; L.biome=biome; L.key.assign(n,0); L.ch.assign(n,' '); L.col.assign(n,Color::Default); }
+    for(int r=r0; r<std::min(m.H,r0+h); ++r) for(int c=c0; c<std::min(m.W,c0+w); ++c){
+        size_t k=(size_t)r*m.W+c; const Cell& cell=m.at(r,c);
+        uint8_t key=(uint8_t)(1+(((int)cell.t<<2)|(cell.visible<<1)|(int)cell.seen));
+        if(L.key[k]==key) continue;
+        L.key[k]=key; tile_look(cell,spec,L.ch[k],L.col[k]);
+    }
+}
+// Sidebar legend, built once per size.
+static const RenderBuf& legend_panel(int H, int W){
+    static RenderBuf rb(0,0);
+    if(rb.H==H && rb.W==W) return rb;
+    rb.reset(H,W);
+    for(int r=0;r<H;r++){
+        rb.set(r,0,'|',Color::Legend);
+        for(int c=1;c<W;c++) rb.set(r,c,' ',Color::Legend);
+    }
+    auto putL = [&](int row, const char* label, char glyph, Color co){
+        if(row>=0 && row<H){
+            rb.set(row, 1, glyph, co);
+            std::string s = std::string(" ")+label;
+            for(size_t i=0;i<s.size() && 3+(int)i<W;i++) rb.set(row, 3+i, s[i], Color::Legend);
+        }
+    };
+    int lr=0;
+    putL(lr++ , "Player", '@', Color::Player);
+    putL(lr++ , "Mob", 'm', Color::Mob);
+    putL(lr++ , "Boss", 'B', Color::Boss);
+    putL(lr++ , "Wall", '#', Color::Wall);
+    putL(lr++ , "Floor", '.', Color::Floor);
+    putL(lr++ , "Door", '+', Color::Door);
+    putL(lr++ , "Open door", '/', Color::Door);
+    putL(lr++ , "Stairs", '>', Color::Stairs);
+    putL(lr++ , "Teleporter", 'T', Color::Teleporter);
+    putL(lr++ , "Trap", '^', Color::Trap);
+    putL(lr++ , "Item", '!', Color::Item);
+    putL(lr++ , "Chest", '*', Color::Chest);
+    putL(lr++ , "Merchant", '$', Color::Item);
+    return rb;
+}
+void compose(Game& g, Frame& f){
+    prof::Scope ps(prof::Render); prof::MemScope mt(prof::MemRender);
+    RenderBuf& rb=f.rb; rb.reset(g.scr_h,g.scr_w);
+    if(screen_too_small(g)){
+        std::string msg="Terminal too small ("+std::to_string(kLegendW+20)+"x"+std::to_string(kHudRows+8)+" needed)";
+        for(int c=0;c<(int)msg.size();c++) rb.set(0,c,msg[c]);
+        f.text.clear();
+        return;
+    }
+    int viewW = view_w(g);
+    int viewH = view_h(g);
+
+    // camera follow
+    if(g.cam_follow){
+        g.cam_r = g.player.pos.r - viewH/2;
+        g.cam_c = g.player.pos.c - viewW/2;
+    }
+    if(g.cam_r < 0) g.cam_r = 0;
+    if(g.cam_c < 0) g.cam_c = 0;
+    if(g.cam_r > g.map.H - viewH) g.cam_r = std::max(0, g.map.H - viewH);
+    if(g.cam_c > g.map.W - viewW) g.cam_c = std::max(0, g.map.W - viewW);
+
+    int legend_x = viewW; // screen column where legend starts
+
+    // tile layer: refresh changed cells in view, then copy whole rows
+    refresh_tiles(g.tiles,g.map,g.biome,g.cam_r,g.cam_c,viewH,viewW);
+    for(int sr=0; sr<viewH; ++sr){
+        int r=g.cam_r+sr; if(r>=g.map.H) break;
+        int n=std::min(viewW,g.map.W-g.cam_c); size_t k=(size_t)r*g.map.W+g.cam_c;
+        std::copy_n(g.tiles.ch.begin()+k,n,rb.ch.begin()+sr*rb.W);
+        std::copy_n(g.tiles.col.begin()+k,n,rb.col.begin()+sr*rb.W);
+    }
+
+    auto in_view = [&](int r,int c){ return r>=g.cam_r && r<g.cam_r+viewH && c>=g.cam_c && c<g.cam_c+viewW; };
+    auto to_screen = [&](int r,int c){ return Pos{ r - g.cam_r, c - g.cam_c }; };
+
+    // entity layer: one pass collects what is on screen, then draw bottom-up
+    // (bombs, merchants, items/chests, mobs); bombs and merchants show even out of sight
+    static std::vector<std::pair<int,int>> sprites; sprites.clear(); // (layer, g.ents index)
+    for(int i=0;i<(int)g.ents.size();i++){
+        const auto& e=g.ents[i];
+        if(e.gone || !in_view(e.pos.r,e.pos.c)) continue;
+        bool vis=g.map.at(e.pos.r,e.pos.c).visible;
+        switch(e.type){
+            case EntityType::BombPlaced: sprites.push_back({0,i}); break;
+            case EntityType::Merchant: sprites.push_back({1,i}); break;
+            case EntityType::ItemEntity: case EntityType::Chest: if(vis) sprites.push_back({2,i}); break;
+            case EntityType::Mob: if(vis && e.mob.alive) sprites.push_back({3,i}); break;
+            default: break;
+        }
+    }
+    std::sort(sprites.begin(),sprites.end());
+    for(auto [layer,i]: sprites){
+        const auto& e=g.ents[i]; Pos s=to_screen(e.pos.r,e.pos.c);
+        switch(e.type){
+            case EntityType::BombPlaced: rb.set(s.r,s.c,'o',Color::Item); break;
+            case EntityType::Merchant: rb.set(s.r,s.c,'$',Color::Item); break;
+            case EntityType::ItemEntity: rb.set(s.r,s.c,e.item.glyph(),Color::Item); break;
+            case EntityType::Chest: rb.set(s.r,s.c,e.chest.opened? '=' : '*',Color::Chest); break;
+            default: rb.set(s.r,s.c,e.mob.glyph(),(e.mob.proto==MonGuardian)? Color::Boss : Color::Mob); break;
+        }
+    }
+    if(in_view(g.player.pos.r,g.player.pos.c)){
+        Pos s = to_screen(g.player.pos.r,g.player.pos.c);
+        rb.set(s.r,s.c,'@', Color::Player);
+    }
+
+    // burning zones overlay
+    for(int k: g.fire.active){
+        Pos ez{ k/g.fire.W, k%g.fire.W };
+        if(in_view(ez.r,ez.c) && g.map.at(ez.r,ez.c).visible){
+            Pos s = to_screen(ez.r,ez.c);
+            rb.set(s.r,s.c,'~', Color::Trap);
+        }
+    }
+    // legend panel (prerendered)
+    const RenderBuf& leg=legend_panel(viewH,kLegendW);
+    for(int r=0;r<leg.H;r++){
+        std::copy_n(leg.ch.begin()+r*leg.W,leg.W,rb.ch.begin()+r*rb.W+legend_x);
+        std::copy_n(leg.col.begin()+r*leg.W,leg.W,rb.col.begin()+r*rb.W+legend_x);
+    }
+
+    // profiler overlay on the last viewport rows
+    if(g.show_prof){
+        std::vector<std::string> stats=prof::overlay(g.scr_w);
+        int n=std::min((int)stats.size(),viewH);
+        for(int i=0;i<n;i++) for(int c=0;c<g.scr_w;c++) rb.set(viewH-n+i,c,c<(int)stats[i].size()? stats[i][c] : ' ',Color::Player);
+    }
+    std::ostringstream text;
+    draw_hud(g,text);
+    g.log.render(g.scr_h,g.scr_w,text);
+    f.text=text.str();
+}
+Screen& screen(){ static Screen s; return s; }
+// Full redraw after a resize or anything else touched the terminal, incremental otherwise.
+void present(const Frame& f){
+    prof::Scope ps(prof::Render); prof::MemScope mt(prof::MemRender);
+    Screen& s=screen();
+    if(io::screen_stale || s.rb.H!=f.rb.H || s.rb.W!=f.rb.W){
+        io::clear();
+        f.rb.flush();
+        std::cout<<f.text;
+    } else {
+        f.rb.flush_diff(s.rb);
+        if(f.text!=s.text) std::cout<<f.text;
+    }
+    io::flush();
+    s.rb=f.rb; s.text=f.text; io::screen_stale=false;
+}
+// Synchronous draw; modals and target_tile rely on the frame being on screen when it returns.
+void render(Game& g){
+    if(g.presenter) g.presenter->sync();
+    Frame f; compose(g,f); present(f);
+}
+// Main-loop draw: handed to the render thread when there is one.
+void submit_frame(Game& g){
+    if(!g.presenter){ render(g); return; }
+    Frame* f=g.presenter->acquire(); compose(g,*f); g.presenter->post(f);
+}
+static int to_int(Tile t){ return (int)t; } static Tile to_tile(int v){ return (Tile)v; }
+// prev: an earlier snapshot whose unchanged bands are shared instead of copied
+std::shared_ptr<const SaveState> snapshot(const Game& g, const SaveState* prev){
+    prof::MemScope mt(prof::MemSave);
+    auto s=std::make_shared<SaveState>();
+    s->level=g.level; s->H=g.map.H; s->W=g.map.W; s->plv=g.plv; s->xp=g.xp; s->opt=g.opt;
+    s->player=g.player; s->pstat=g.pstat; s->inv=g.inv; s->kills=g.kills;
+    s->ents.assign(g.ents.begin(),g.ents.end());
+    bool reuse= prev && prev->H==s->H && prev->W==s->W;
+    std::vector<uint8_t> band;
+    for(int r0=0,b=0; r0<s->H; r0+=SaveState::kBandRows,b++){
+        int rows=std::min(SaveState::kBandRows,s->H-r0);
+        band.resize((size_t)rows*s->W);
+        for(int r=0;r<rows;r++) for(int c=0;c<s->W;c++){ const Cell& x=g.map.at(r0+r,c); band[(size_t)r*s->W+c]=(uint8_t)(to_int(x.t)<<1 | (x.seen?1:0)); }
+        if(reuse && *prev->bands[b]==band) s->bands.push_back(prev->bands[b]);
+        else s->bands.push_back(std::make_shared<const std::vector<uint8_t>>(band));
+    }
+    return s;
+}
+void write_save(const SaveState& s, std::ostream& f){
+    prof::MemScope mt(prof::MemSave);
+    const Stats& st=s.player.mob.st; const auto& fx=s.pstat.fx;
+    f<<"LEVEL "<<s.level<<" "<<s.H<<" "<<s.W<<" "<<s.plv<<" "<<s.xp<<" "<<s.opt.auto_open_on_bump<<" "<<s.opt.auto_pickup_keys<<"\n";
+    f<<"PR "<<s.player.pos.r<<" "<<s.player.pos.c<<" "<<st.hp<<" "<<st.max_hp<<" "<<st.atk<<" "<<st.def<<" "<<st.str<<" "<<st.mp<<" "<<st.max_mp<<" "<<fx[FxBurn]<<" "<<fx[FxSnare]<<" "<<fx[FxPoison]<<" "<<fx[FxRegen]<<" "<<fx[FxShield]<<"\n";
+    f<<"IN "<<s.inv.keys<<" "<<s.inv.weapon_idx<<" "<<s.inv.armor_idx<<" "<<s.inv.items.size()<<"\n";
+    for(auto& it: s.inv.items) f<<"IT "<<(int)it.kind()<<" "<<it.name()<<"| "<<(int)it.glyph()<<" "<<it.power<<"\n";
+    f<<"SP "<<s.inv.spells.size()<<"\n"; for(auto sp: s.inv.spells) f<<(int)sp<<"\n";
+    f<<"KILL "<<std::count_if(s.kills.begin(),s.kills.end(),[](int n){ return n>0; })<<"\n";
+    for(size_t i=0;i<s.kills.size();i++) if(s.kills[i]) f<<content().mons[i].name<<"| "<<s.kills[i]<<"\n";
+    f<<"EN "<<s.ents.size()<<"\n";
+    for(auto& e: s.ents){
+        if(e.type==EntityType::Mob){
+            f<<"MOB "<<e.pos.r<<" "<<e.pos.c<<" "<<(int)e.mob.alive<<" "<<e.mob.name()<<"| "<<(int)e.mob.glyph()<<" "<<e.mob.st.max_hp<<" "<<e.mob.st.hp<<" "<<e.mob.st.atk<<" "<<e.mob.st.def<<" "<<e.mob.st.str<<" "<<e.mob.xp<<"\n";
+        } else if(e.type==EntityType::ItemEntity){
+            f<<"ITM "<<e.pos.r<<" "<<e.pos.c<<" "<<(int)e.item.kind()<<" "<<e.item.name()<<"| "<<(int)e.item.glyph()<<" "<<e.item.power<<"\n";
+        } else if(e.type==EntityType::Chest){
+            f<<"CHS "<<e.pos.r<<" "<<e.pos.c<<" "<<(int)e.chest.locked<<" "<<(int)e.chest.opened<<" "<<(int)e.chest.content.kind()<<" "<<e.chest.content.name()<<"| "<<(int)e.chest.content.glyph()<<" "<<e.chest.content.power<<"\n";
+        }
+    }
+    f<<"MP "<<s.H<<"\n";
+    for(int r=0;r<s.H;r++){ for(int c=0;c<s.W;c++){ int v=s.cell(r,c); f<<(v>>1)<<" "<<(v&1)<<" "; } f<<"\n"; }
+}
+// Writes path.tmp, syncs it to disk and renames it over path: after a crash the file is the old save or
+// the new one, never a torn mix.
+bool commit_file(const std::string& path, const std::string& data){
+    std::string tmp=path+".tmp";
+#ifdef _WIN32
+    HANDLE h=CreateFileA(tmp.c_str(),GENERIC_WRITE,0,nullptr,CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,nullptr);
+    if(h==INVALID_HANDLE_VALUE) return false;
+    DWORD put=0;
+    bool ok= WriteFile(h,data.data(),(DWORD)data.size(),&put,nullptr) && put==data.size() && FlushFileBuffers(h);
+    ok = CloseHandle(h) && ok;
+    // WRITE_THROUGH covers the rename; FlushFileBuffers above covers the contents
+    if(!ok || !MoveFileExA(tmp.c_str(),path.c_str(),MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH)){ std::remove(tmp.c_str()); return false; }
+    return true;
+#else
+    int fd=::open(tmp.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644); if(fd<0) return false;
+    const char* p=data.data(); size_t left=data.size(); bool ok=true;
+    while(ok && left){ ssize_t n=::write(fd,p,left); if(n<0){ ok= errno==EINTR; continue; } p+=n; left-=(size_t)n; }
+    ok = ok && ::fsync(fd)==0; ok = ::close(fd)==0 && ok;
+    if(!ok || std::rename(tmp.c_str(),path.c_str())!=0){ std::remove(tmp.c_str()); return false; }
+    // the rename is only durable once the directory entry is
+    auto slash=path.find_last_of('/'); std::string dir= slash==std::string::npos? "." : path.substr(0,slash+1);
+    int dfd=::open(dir.c_str(),O_RDONLY); if(dfd>=0){ ::fsync(dfd); ::close(dfd); }
+    return true;
+#endif
+}
+bool save_game(const Game& g, const std::string& path){
+    std::ostringstream f; write_save(*snapshot(g),f); return commit_file(path,f.str());
+}
+// Saves name prototypes rather than numbering them, so they survive content edits.
+// Unknown names fall back to the kind's first prototype (items) or a generic monster. The saved kind wins
+// over the name: a renamed or split item never loads as a different kind.
+static uint16_t item_proto_named(const std::string& name, int kind){
+    const Content& C=content(); auto it=C.item_by_name.find(name);
+    bool known_kind= kind>=0 && kind<kItemKindCount;
+    if(it!=C.item_by_name.end() && (!known_kind || (int)C.items[it->second].kind==kind)) return it->second;
+    if(known_kind && !C.items_of_kind[kind].empty()) return C.items_of_kind[kind][0];
+    return it!=C.item_by_name.end()? it->second : 0;
+}
+// Names may contain spaces; the save terminates them with '|'.
+static std::string read_name(std::istream& in){ std::string n; in>>std::ws; std::getline(in,n,'|'); return n; }
+static uint16_t mon_proto_named(const std::string& name){
+    const Content& C=content(); auto it=C.mon_by_name.find(name);
+    return it!=C.mon_by_name.end()? it->second : (uint16_t)MonFirstRandom;
+}
+bool load_game(Game& g, const std::string& path){
+    prof::MemScope mt(prof::MemSave);
+    std::ifstream f(path); if(!f) return false; std::string tag; int H,W;
+    f>>tag>>g.level>>H>>W>>g.plv>>g.xp>>g.opt.auto_open_on_bump>>g.opt.auto_pickup_keys; if(tag!="LEVEL") return false; g.map=Map(H,W);
+    int r,c; f>>tag>>r>>c>>g.player.mob.st.hp>>g.player.mob.st.max_hp>>g.player.mob.st.atk>>g.player.mob.st.def>>g.player.mob.st.str>>g.player.mob.st.mp>>g.player.mob.st.max_mp>>g.pstat.fx[FxBurn]>>g.pstat.fx[FxSnare]>>g.pstat.fx[FxPoison]>>g.pstat.fx[FxRegen]>>g.pstat.fx[FxShield]; fx_refresh(g.pstat); g.player.pos={r,c};
+    int nitems; f>>tag>>g.inv.keys>>g.inv.weapon_idx>>g.inv.armor_idx>>nitems; g.inv.items.clear();
+ std::string line; std::getline(f,line);
+
+    for(int i=0;i<nitems;i++){ std::getline(f,line);
+ std::istringstream ss(line);
+ std::string itag; ss>>itag; int kind,glyph,power; std::string namepipe; ss>>kind; namepipe=read_name(ss); ss>>glyph>>power;
+ Item it; it.proto=item_proto_named(namepipe,kind); it.power=power; g.inv.items.push_back(it);
+ }
+    int nsp; f>>tag>>nsp; g.inv.spells.clear();
+ for(int i=0;i<nsp;i++){ int s; f>>s; g.inv.spells.push_back((SpellKind)s);
+ }
+    int nk; f>>tag>>nk; g.kills.assign(content().mons.size(),0);
+ std::getline(f,line);
+ for(int i=0;i<nk;i++){ std::getline(f,line);
+ std::istringstream ss(line);
+ std::string namepipe; int cnt; namepipe=read_name(ss); ss>>cnt;
+ auto m=content().mon_by_name.find(namepipe); if(m!=content().mon_by_name.end()){ if(g.kills.size()<=m->second) g.kills.resize(content().mons.size(),0); g.kills[m->second]=cnt; } }
+    int nents; f>>tag>>nents; std::getline(f,line);
+ release_level(g);
+
+    for(int i=0;i<nents;i++){ std::getline(f,line);
+ std::istringstream ss(line);
+ std::string et; ss>>et;
+        if(et=="MOB"){ Entity e{}; e.type=EntityType::Mob; int alive,glyph; ss>>e.pos.r>>e.pos.c>>alive; e.mob.alive=alive!=0; std::string namepipe=read_name(ss); ss>>glyph>>e.mob.st.max_hp>>e.mob.st.hp>>e.mob.st.atk>>e.mob.st.def>>e.mob.st.str>>e.mob.xp;
+ e.mob.proto=mon_proto_named(namepipe); spawn(g,e);
+ }
+        else if(et=="ITM"){ Entity e{}; e.type=EntityType::ItemEntity; e.blocks=false; int kind,glyph,power; ss>>e.pos.r>>e.pos.c>>kind; std::string namepipe=read_name(ss); ss>>glyph>>power;
+ e.item.proto=item_proto_named(namepipe,kind); e.item.power=power; spawn(g,e);
+ }
+        else if(et=="CHS"){ Entity e{}; e.type=EntityType::Chest; e.blocks=true; int locked,opened,kind,glyph,power; ss>>e.pos.r>>e.pos.c>>locked>>opened>>kind; std::string namepipe=read_name(ss); ss>>glyph>>power;
+ e.chest.locked=locked!=0; e.chest.opened=opened!=0; e.chest.content.proto=item_proto_named(namepipe,kind); e.chest.content.power=power; spawn(g,e);
+ }
+    }
+    int Hhdr; f>>tag>>Hhdr; std::getline(f,line);
+ for(int rr=0; rr<g.map.H; rr++){ std::getline(f,line);
+ std::istringstream ss(line);
+ for(int cc=0; cc<g.map.W; cc++){ int t,seen; ss>>t>>seen; g.map.at(rr,cc).t=to_tile(t);
+ g.map.at(rr,cc).seen=(seen!=0);
+ } }
+    return true;
+}
+
+// ---------------- Input/Turns ----------------
+void move_or_attack(Game& g,int dr,int dc){
+    if(g.pstat.fx[FxSnare]>0){ g.log.add("You are snared!"); return; }
+    int nr=g.player.pos.r+dr, nc=g.player.pos.c+dc; if(!g.map.in(nr,nc)) return;
+    if(is_closed_door(g.map,nr,nc) && g.opt.auto_open_on_bump){ open_door(g,nr,nc); return; }
+    if(g.map.at(nr,nc).t==Tile::TrapHidden){ trigger_trap(g,nr,nc); g.player.pos={nr,nc}; return; }
+    if(Entity* m=mob_at(g,nr,nc)){ attack(g,g.player,*m); return; }
+    if(g.map.walkable(nr,nc) && !occupied(g,nr,nc)) g.player.pos={nr,nc};
+}
+
+// ---------------- AI ----------------
+static WorkPool& ai_pool(){ static WorkPool pool(std::max(1u,std::thread::hardware_concurrency())-1); return pool; }
+// Blocking snapshot equivalent to occupied() for every tile.
+static void snapshot_occupancy(const Game& g, std::vector<uint8_t>& occ){
+    occ.assign((size_t)g.map.H*g.map.W,0);
+    occ[g.player.pos.r*g.map.W+g.player.pos.c]=1;
+    for(auto& e: g.ents) if(e.type!=EntityType::ItemEntity && e.mob.alive && e.blocks && g.map.in(e.pos.r,e.pos.c)) occ[e.pos.r*g.map.W+e.pos.c]=1;
+}
+// Phase 1: pure decision against the snapshot. Must not touch g (runs on worker threads).
+static void plan_mob(const Game& g, const std::vector<uint8_t>& occ, AiPlan& p){
+    const Entity& e=g.ents[p.ent]; FastRNG rng{p.seed};
+    auto free_at=[&](int r,int c){ return g.map.walkable(r,c) && !occ[r*g.map.W+c]; };
+    static const int dr[5]={-1,1,0,0,0}, dc[5]={0,0,-1,1,0};
+    if(e.mob.ai==AiKind::Wander){
+        int dir=rng.i(0,4); Pos n{e.pos.r+dr[dir], e.pos.c+dc[dir]};
+        if(n==g.player.pos) p={p.ent,p.seed,Intent::Attack,n};
+        else if(free_at(n.r,n.c)) p={p.ent,p.seed,Intent::Step,n};
+    } else if(g.map.at(e.pos.r,e.pos.c).visible){
+        thread_local std::vector<Pos> path; // per worker, reused: planning a step allocates nothing
+        if(astar(g.map,e.pos,g.player.pos,path) && path.size()>=2){
+            Pos step=path[1];
+            if(step==g.player.pos) p={p.ent,p.seed,Intent::Attack,step};
+            else if(!occ[step.r*g.map.W+step.c]) p={p.ent,p.seed,Intent::Step,step};
+        }
+    } else if(rng.chance(0.3)){
+        int dir=rng.i(0,4); Pos n{e.pos.r+dr[dir], e.pos.c+dc[dir]};
+        if(free_at(n.r,n.c)) p={p.ent,p.seed,Intent::Step,n};
+    }
+}
+// Phase 2: commit in entity order. A step whose target was claimed earlier in this pass is dropped.
+static void resolve_plans(Game& g, std::vector<uint8_t>& occ, const std::vector<AiPlan>& plans){
+    for(const auto& p: plans){
+        Entity& e=g.ents[p.ent];
+        if(!e.mob.alive) continue;
+        if(p.kind==Intent::Attack) attack(g,e,g.player);
+        else if(p.kind==Intent::Step){
+            int to=p.to.r*g.map.W+p.to.c; if(occ[to]) continue;
+            occ[e.pos.r*g.map.W+e.pos.c]=0;
+            if(g.map.at(p.to.r,p.to.c).t==Tile::TrapHidden) trigger_trap_on_entity(g,e,p.to.r,p.to.c);
+            move_ent(g,p.ent,p.to); occ[to]=1;
+        }
+    }
+}
+// BFS over passable tiles (closed doors count: the player can open them), capped at the radius.
+static void update_wake_field(Game& g){
+    size_t n=(size_t)g.map.H*g.map.W;
+    if(g.wake_dist.size()!=n){ g.wake_dist.assign(n,0); g.wake_stamp.assign(n,-1); }
+    static std::vector<int> q; q.clear();
+    int s=g.player.pos.r*g.map.W+g.player.pos.c;
+    g.wake_stamp[s]=g.turn; g.wake_dist[s]=0; q.push_back(s);
+    for(size_t h=0; h<q.size(); ++h){
+        int cur=q[h]; if(g.wake_dist[cur]>=g.opt.wake_radius) continue;
+        int r=cur/g.map.W, c=cur%g.map.W; static const int dr[4]={-1,1,0,0}, dc[4]={0,0,-1,1};
+        for(int d=0; d<4; ++d){
+            int nr=r+dr[d], nc=c+dc[d];
+            if(!g.map.walkable(nr,nc) && !is_closed_door(g.map,nr,nc)) continue;
+            int k=nr*g.map.W+nc; if(g.wake_stamp[k]==g.turn) continue;
+            g.wake_stamp[k]=g.turn; g.wake_dist[k]=g.wake_dist[cur]+1; q.push_back(k);
+        }
+    }
+}
+static AiTier ai_tier(const Game& g, const Entity& e){
+    if(g.map.at(e.pos.r,e.pos.c).visible) return AiTier::Visible;
+    return g.wake_stamp[e.pos.r*g.map.W+e.pos.c]==g.turn? AiTier::Near : AiTier::Dormant;
+}
+// Replays the status ticks a mob skipped while dormant, tick by tick as process_statuses would: regen is capped
+// at max_hp every tick and the replay stops at the first tick hp reaches 0. Bounded by the longest timer.
+static void catch_up_statuses(Game& g, Entity& e, int turns){
+    int j=e.mob.fx_row; if(j<0) return;
+    auto& st=e.mob.st; auto& fx=g.status.fx;
+    int steps=0; for(auto& c: fx) steps=std::max<int>(steps,c[j]);
+    steps=std::min(steps,turns);
+    bool hurt=false;
+    for(int t=0;t<steps && st.hp>0;t++){
+        int dmg=(fx[FxBurn][j]>0)+(fx[FxPoison][j]>0), heal=(fx[FxRegen][j]>0);
+        for(auto& c: fx) c[j]=(int16_t)(c[j]-(c[j]>0));
+        st.hp=std::min(st.max_hp, st.hp+heal)-dmg; hurt|=dmg>0;
+    }
+    if(hurt) post(g,{ent_index(g,e),-1,0,0,0,0,Cause::Ailment}); // hp already settled; lets the resolver handle death
+}
+void ai_turn(Game& g){
+    prof::Scope ps(prof::Ai); prof::MemScope mt(prof::MemAi);
+    static std::vector<uint8_t> occ; static std::vector<AiPlan> plans; static std::vector<AiTier> tier;
+    g.turn++;
+    resolve_events(g); // the player's action
+    update_wake_field(g);
+    tier.assign(g.ents.size(),AiTier::Dormant);
+    for(size_t i=0;i<g.ents.size();++i){
+        auto& e=g.ents[i];
+        if(e.type!=EntityType::Mob || !e.mob.alive) continue;
+        tier[i]=ai_tier(g,e);
+        if(tier[i]==AiTier::Dormant){ if(e.mob.dormant_since<0) e.mob.dormant_since=g.turn; continue; }
+        if(e.mob.dormant_since>=0){
+            catch_up_statuses(g,e,g.turn-e.mob.dormant_since); e.mob.dormant_since=-1;
+            resolve_events(g); // settles a death from the replayed ticks before the mob can act
+            if(!e.mob.alive) continue;
+        }
+        e.mob.energy = tier[i]==AiTier::Visible? e.mob.energy+e.mob.speed : std::min(100, e.mob.energy+e.mob.speed);
+    }
+    // up to three actions per visible mob per turn, one round each
+    for(int round=0; round<3; ++round){
+        plans.clear();
+        for(int i=0;i<(int)g.ents.size();++i){
+            auto& e=g.ents[i];
+            if(tier[i]==AiTier::Dormant || !e.mob.alive || e.mob.energy<100) continue;
+            e.mob.energy -= 100;
+            // snared: consume a turn doing nothing
+            if(e.mob.fx_row>=0 && g.status.fx[FxSnare][e.mob.fx_row]>0){ g.status.fx[FxSnare][e.mob.fx_row]--; continue; }
+            plans.push_back({i, g.rng.eng()});
+        }
+        if(plans.empty()) continue;
+        snapshot_occupancy(g,occ);
+        ai_pool().run((int)plans.size(),[&](int k){ plan_mob(g,occ,plans[k]); });
+        resolve_plans(g,occ,plans);
+        resolve_events(g);
+    }
+}
+
+// ---------------- Tips ----------------
+// Tips come from the content pack, or from tips.txt read once at startup; nothing touches the disk per level.
+void load_tips_file(Content& c, const char* path){
+    std::ifstream f(path); std::string s;
+    while(f && std::getline(f,s) && c.tips.size()<1000){ if(!s.empty()) c.tips.push_back(s); }
+}
+static void maybe_tip(Game& g){
+    const auto& tips=content().tips;
+    if(!tips.empty() && g.rng.chance(0.35)) g.log.add(tips[g.rng.i(0,(int)tips.size()-1)]);
+}
+
+// ---------------- Setup ----------------
+static void init_player(Game& g){ g.player.type=EntityType::Player; g.player.blocks=true; g.player.mob.proto=MonPlayer; g.player.mob.st={20,20,3,1,10, 12,12}; g.pstat=PlayerStatus{}; g.inv=Inventory{}; g.plv=1; g.xp=0; }
+static void add_secret_rooms(Game& g){
+    int rooms = g.rng.i(1,2);
+    for(int k=0;k<rooms;k++){
+        int h=g.rng.i(3,5), w=g.rng.i(3,5);
+        int r=g.rng.i(2, g.map.H-h-3);
+        int c=g.rng.i(2, g.map.W-w-23);
+        bool ok=true;
+        for(int rr=r-1; rr<r+h+1; rr++) for(int cc=c-1; cc<c+w+1; cc++){ if(!g.map.in(rr,cc) || g.map.at(rr,cc).t!=Tile::Wall){ ok=false; break; } if(!ok) break; }
+        if(!ok) continue;
+        for(int rr=r; rr<r+h; rr++) for(int cc=c; cc<c+w; cc++) g.map.at(rr,cc).t=Tile::Floor;
+        for(int rr=r-1; rr<r+h+1; rr++){ g.map.at(rr,c-1).t=Tile::SecretWall; g.map.at(rr,c+w).t=Tile::SecretWall; }
+        for(int cc=c-1; cc<c+w+1; cc++){ g.map.at(r-1,cc).t=Tile::SecretWall; g.map.at(r+h,cc).t=Tile::SecretWall; }
+        Entity ch{}; ch.type=EntityType::Chest; ch.blocks=false; ch.pos={r+h/2, c+w/2}; ch.chest.locked=g.rng.chance(0.5);
+ ch.chest.opened=false; ch.chest.content=make_random_item(g.rng);
+ spawn(g,ch);
+
+    }
+}
+static void new_level(Game& g){ prof::MemScope mt(prof::MemLevel); release_level(g);
+ auto rooms=generate_dungeon(g.map,g.rng,g.biome);
+ place_player(g,rooms);
+ place_mobs_items_chests(g,rooms);
+    // maybe place merchant near first room center
+    if(g.rng.chance(0.25) && !rooms.empty()){
+        Pos c{ rooms[0].r + rooms[0].h/2, rooms[0].c + rooms[0].w/2 };
+        Entity m{}; m.type=EntityType::Merchant; m.blocks=false; m.pos=c;
+        spawn(g,m);
+    }
+
+
+    add_secret_rooms(g);
+    // record teleporter position
+    g.teleporter = {-1,-1};
+    for(int r=0;r<g.map.H;r++) for(int c=0;c<g.map.W;c++) if(g.map.at(r,c).t==Tile::Teleporter) g.teleporter = {r,c};
+    if(g.teleporter.r<0 && !rooms.empty()){
+        // choose farthest room center from player
+        Pos best = Pos{ rooms[0].r + rooms[0].h/2, rooms[0].c + rooms[0].w/2 };
+        int bestd = -1;
+        for(auto& R: rooms){
+            Pos cc{ R.r + R.h/2, R.c + R.w/2 };
+            int d = std::abs(cc.r - g.player.pos.r) + std::abs(cc.c - g.player.pos.c);
+            if(d > bestd){ bestd=d; best=cc; }
+        }
+        if(g.map.walkable(best.r,best.c)){ g.map.at(best.r,best.c).t = Tile::Teleporter; g.teleporter = best; }
+    }
+
+    // spawn boss guarding the teleporter (exactly on it)
+    if(g.teleporter.r>=0){
+        Entity boss{}; boss.type=EntityType::Mob; boss.blocks=true; boss.pos = g.teleporter;
+        boss.mob.proto=MonGuardian;
+        boss.mob.st.max_hp=boss.mob.st.hp=28 + g.level*4;
+        boss.mob.st.atk=6 + g.level;
+        boss.mob.st.def=3 + g.level/2;
+        boss.mob.st.str=14 + g.level;
+        boss.mob.ai=AiKind::Hunter; boss.mob.alive=true; boss.mob.xp=20 + g.level*5;
+        spawn(g,boss);
+    }
+ g.log.add("You descend to level "+std::to_string(g.level)+" ["+biome_spec(g.biome).name+"].");
+ maybe_tip(g);
+ compute_fov(g.map,g.player.pos.r,g.player.pos.c,10);
+ }
+void next_level(Game& g){ if(g.level>=g.max_level){ g.log.add("You reach the bottom. Victory!");
+ g.running=false; return; } g.level++; new_level(g);
+ }
+void new_game(Game& g){ g.level=1; init_player(g);
+ new_level(g);
+ g.log.add("Welcome!");
+ }
+
+// ---------------- Spells ----------------
+// Same rays as the FOV, walked from the target back to the caster; the target cell counts, the caster's does not.
+static bool los_clear(const Map& m,Pos a,Pos b){
+    int dr=b.r-a.r, dc=b.c-a.c;
+    if(std::abs(dr)+std::abs(dc)>kRayRadius) return false; // past any spell's reach
+    for(int i=kRays.end_of[ray_slot(dr,dc)]; i>0; i=kRays.node[i].parent) if(opaque(m,a.r+kRays.node[i].dr,a.c+kRays.node[i].dc)) return false;
+    return true;
+}
+void cast_firebolt(Game& g,int dr,int dc){
+    int fb_boost=g.inv.boost(SpellKind::Firebolt); int fb_cost=std::max(1,3 - fb_boost); if(g.player.mob.st.mp<fb_cost){ g.log.add("Not enough MP ("+std::to_string(fb_cost)+")."); return; } g.player.mob.st.mp-=fb_cost;
+    int r=g.player.pos.r,c=g.player.pos.c;
+    while(true){ r+=dr; c+=dc; if(opaque(g.map,r,c)) break; // stops on the sentinel ring at the latest
+        if(int i=mob_index_at(g,r,c); i>=0){ post(g,{i,-1,(int16_t)(4+g.rng.i(0,3)+fb_boost),2,0,0,Cause::Firebolt}); return; }
+    } g.log.add("The firebolt fizzles."); }
+void cast_heal(Game& g){ if(g.player.mob.st.mp<4){ g.log.add("Not enough MP (4).");
+ return; } g.player.mob.st.mp-=4; int before=g.player.mob.st.hp; g.player.mob.st.hp=std::min(g.player.mob.st.max_hp,g.player.mob.st.hp+6);
+ g.log.add("You cast Heal ("+std::to_string(g.player.mob.st.hp-before)+" HP).");
+ }
+void cast_ice(Game& g,Pos target){
+    int i_boost=g.inv.boost(SpellKind::IceShard); int i_cost=std::max(2,4 - i_boost); if(g.player.mob.st.mp<i_cost){ g.log.add("Not enough MP ("+std::to_string(i_cost)+")."); return; } g.player.mob.st.mp-=i_cost;
+    if(!g.map.in(target.r,target.c) || !los_clear(g.map,g.player.pos,target)){ g.log.add("No line of sight."); return; }
+    if(int i=mob_index_at(g,target.r,target.c); i>=0){ post(g,{i,-1,(int16_t)(3+g.rng.i(0,2)),0,2,0,Cause::IceShard}); return; }
+    g.log.add("The shard shatters harmlessly.");
+}
+void cast_shield(Game& g){
+    int boost=g.inv.boost(SpellKind::Shield);
+    int cost=std::max(1,3-boost);
+    if(g.player.mob.st.mp<cost){ g.log.add("Not enough MP ("+std::to_string(cost)+")."); return; }
+    g.player.mob.st.mp -= cost;
+    fx_set(g.pstat,FxShield,5 + boost);
+    g.pstat.shield_bonus = 2 + boost;
+    g.log.add("A protective aura surrounds you (+DEF "+std::to_string(2+boost)+" for "+std::to_string(5+boost)+"t).");
+}
+void cast_fireball(Game& g, Pos target){
+    int boost = g.inv.boost(SpellKind::Fireball);
+    int cost = std::max(2, 6 - boost);
+    if(g.player.mob.st.mp < cost){ g.log.add("Not enough MP ("+std::to_string(cost)+")."); return; }
+    g.player.mob.st.mp -= cost;
+    if(!g.map.in(target.r,target.c) || !los_clear(g.map,g.player.pos,target)){ g.log.add("No line of sight."); return; }
+    int radius = 2 + (boost>=3?1:0);
+    auto inR = [&](int r,int c){ return std::abs(r-target.r)+std::abs(c-target.c) <= radius; };
+    if(inR(g.player.pos.r,g.player.pos.c)) post(g,{-1,-1,(int16_t)(g.rng.i(2,4)+boost),2,0,0,Cause::Fireball});
+    for_each_in_area(g,target,radius,false,[&](int i){ const auto& e=g.ents[i];
+        if(e.type==EntityType::Mob && e.mob.alive) post(g,{i,-1,(int16_t)(g.rng.i(4,7)+boost),2,0,0,Cause::Fireball}); });
+    for(int r=target.r-radius; r<=target.r+radius; ++r){
+        for(int c=target.c-radius; c<=target.c+radius; ++c){
+            if(!g.map.in(r,c)) continue;
+            if(inR(r,c) && g.map.walkable(r,c)){
+                g.fire.ignite(r,c,3 + boost);
+            }
+        }
+    }
+    g.log.add("You cast Fireball.");
+}
+int price_of(const Item& it){ return it.data().price; }
+bool near_merchant(Game& g){
+    for(auto& e: g.ents){
+        if(e.type==EntityType::Merchant){
+            int dr = std::abs(e.pos.r - g.player.pos.r);
+            int dc = std::abs(e.pos.c - g.player.pos.c);
+            if(dr+dc <= 1) return true;
+            if(e.pos == g.player.pos) return true;
+        }
+    }
+    return false;
+}
+void world_tick(Game& g){
+    prof::Scope ps(prof::World);
+    // burning zones
+    for(size_t j=0;j<g.fire.active.size();){
+        int k=g.fire.active[j]; Pos z{ k/g.fire.W, k%g.fire.W };
+        if(g.player.pos==z) post(g,{-1,-1,0,1,0,0,Cause::Ailment});
+        for(int i=g.grid.first(z.r,z.c); i!=-1; i=g.grid.next[i]){ auto& e=g.ents[i]; if(e.type==EntityType::Mob && e.mob.alive) post(g,{i,-1,0,1,0,0,Cause::Ailment}); }
+        if(--g.fire.ttl[k]==0) g.fire.extinguish(j);
+        else ++j;
+    }
+    // bombs: tick fuse and explode when zero (3x3 square => Chebyshev radius 1)
+    for(size_t i=0;i<g.ents.size();++i){
+        auto& e = g.ents[i];
+        if(e.type==EntityType::BombPlaced && !e.gone){
+            e.fuse--;
+            if(e.fuse<=0){
+                explode_at(g, e.pos.r, e.pos.c, 1, true);
+                consume(g,g.ents[i]);
+            }
+        }
+    }
+    resolve_events(g);
+    compact_entities(g);
+    apply_kill_events(g);
+}
+
+// ---------------- Travel ----------------
+static bool travel_passable(const Game& g,int r,int c){
+    if(!g.map.in(r,c) || !g.map.at(r,c).seen) return false;
+    if(g.map.at(r,c).t==Tile::DoorClosed) return g.opt.auto_open_on_bump;
+    return g.map.walkable(r,c);
+}
+static bool travel_goal(Game& g,TravelGoal goal,int r,int c){
+    switch(goal){
+        case TravelGoal::Teleporter: return Pos{r,c}==g.teleporter;
+        case TravelGoal::Item: return item_at(g,r,c)!=nullptr;
+        case TravelGoal::Explore:
+            for(auto [dr,dc]: {std::pair{-1,0},{1,0},{0,-1},{0,1}}) if(g.map.in(r+dr,c+dc) && !g.map.at(r+dr,c+dc).seen) return true;
+            return false;
+    }
+    return false;
+}
+// Nearest goal tile by BFS from the player (excluding the player's own tile); empty when unreachable.
+std::vector<Pos> travel_route(Game& g,TravelGoal goal){
+    prof::MemScope mt(prof::MemPath); ScratchScope mem;
+    const int W=g.map.W; std::pmr::vector<int> from((size_t)g.map.H*W,-1,*mem);
+    const int s=g.player.pos.r*W+g.player.pos.c; from[s]=s;
+    std::pmr::vector<int> q({s},*mem);
+    for(size_t h=0; h<q.size(); ++h){
+        int k=q[h]; int r=k/W, c=k%W;
+        if(k!=s && travel_goal(g,goal,r,c)){
+            std::vector<Pos> path;
+            for(int p=k; p!=s; p=from[p]) path.push_back({p/W,p%W});
+            std::reverse(path.begin(),path.end());
+            return path;
+        }
+        for(auto [dr,dc]: {std::pair{-1,0},{1,0},{0,-1},{0,1}}){
+            int nr=r+dr, nc=c+dc;
+            if(travel_passable(g,nr,nc) && from[nr*W+nc]<0){ from[nr*W+nc]=k; q.push_back(nr*W+nc); }
+        }
+    }
+    return {};
+}
+bool hostile_in_view(const Game& g){
+    for(auto& e: g.ents) if(e.type==EntityType::Mob && e.mob.alive && g.map.at(e.pos.r,e.pos.c).visible) return true;
+    return false;
+}
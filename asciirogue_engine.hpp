@@ -0,0 +1,909 @@
+// asciirogue_v2 engine: game state, generation, AI, combat, rendering to a frame, saves, profiling.
+// The terminal front end (asciirogue_v2.cpp) and the micro-benchmarks (asciirogue_bench.cpp) both link it.
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+  #include <pthread.h>
+  #include <signal.h>
+#endif
+
+// Output side of the terminal layer; key input, raw mode and resize watching live with the front end (asciirogue_v2.cpp).
+namespace io {
+// Decoded keys: plain bytes pass through, arrows map above the byte range, a lone ESC stays 27.
+enum Key:int{ KeyNone=0, KeyEsc=27, KeyUp=0x100, KeyDown, KeyLeft, KeyRight, KeyResize };
+// Set whenever something other than present() draws (modals clear the screen); forces the next full redraw.
+inline std::atomic<bool> screen_stale{true};
+inline void invalidate(){ screen_stale=true; }
+inline void clear(){ std::cout << "\x1b[2J\x1b[H"; invalidate(); }
+inline void move(int r,int c,std::ostream& os=std::cout){ os << "\x1b["<<(r+1)<<";"<<(c+1)<<"H"; }
+inline void hideCursor(){ std::cout << "\x1b[?25l"; }
+inline void showCursor(){ std::cout << "\x1b[?25h"; }
+inline void flush(){ std::cout.flush(); }
+} // namespace io
+
+// ---------------- Profiling ----------------
+// Scoped phase timers and hot-path counters. Totals roll over once per main-loop frame (end_frame);
+// the previous frame feeds the 'P' overlay. With --trace FILE every scope is also kept for a Chrome trace dump.
+namespace prof {
+enum Phase:int{ Fov, Render, Ai, Astar, Statuses, World, PhaseCount };
+enum Counter:int{ AstarNodes, FovCells, TermBytes, Allocs, CounterCount };
+inline constexpr const char* phase_names[PhaseCount]={"fov","render","ai","astar","status","world"};
+inline constexpr const char* counter_names[CounterCount]={"astar_nodes","fov_cells","term_bytes","allocs"};
+inline constexpr const char* phase_short[PhaseCount]={"fov","ren","ai","a*","st","wt"};
+inline constexpr const char* counter_short[CounterCount]={"a*n","fovc","tty","new"};
+using Clock=std::chrono::steady_clock;
+struct TraceEv{ int phase; uint32_t tid; int64_t ts_us, dur_us; };
+struct FrameEv{ int64_t ts_us; uint64_t cnt[CounterCount]; };
+struct State{
+    std::atomic<uint64_t> ns[PhaseCount]{}; std::atomic<uint64_t> cnt[CounterCount]{};
+    uint64_t last_ns[PhaseCount]{}, last_cnt[CounterCount]{};
+    bool tracing=false; Clock::time_point epoch=Clock::now();
+    std::mutex mu; std::vector<TraceEv> trace; std::vector<FrameEv> frames;
+};
+inline State& state(){ static State s; return s; }
+inline void count(Counter c, uint64_t n=1){ state().cnt[c].fetch_add(n,std::memory_order_relaxed); }
+inline int64_t since_epoch_us(Clock::time_point t){ return std::chrono::duration_cast<std::chrono::microseconds>(t-state().epoch).count(); }
+struct Scope{
+    Phase p; Clock::time_point t0=Clock::now();
+    explicit Scope(Phase ph):p(ph){}
+    ~Scope(){
+        auto t1=Clock::now(); State& s=state();
+        s.ns[p].fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1-t0).count(),std::memory_order_relaxed);
+        if(s.tracing){ std::lock_guard<std::mutex> lk(s.mu); s.trace.push_back({p,(uint32_t)std::hash<std::thread::id>{}(std::this_thread::get_id()),since_epoch_us(t0),since_epoch_us(t1)-since_epoch_us(t0)}); }
+    }
+};
+// Accumulates locally, publishes once: keeps atomics out of inner loops.
+struct Tally{ Counter c; uint64_t n=0; explicit Tally(Counter cc):c(cc){} ~Tally(){ if(n) count(c,n); } };
+
+// Tagged heap accounting, compiled in with -DASCIIROGUE_MEMTAGS. A MemScope names the subsystem for
+// allocations made on this thread until it closes; each block carries its tag so a free is charged back
+// to whoever allocated it. Without the flag MemScope is empty and operator new only counts.
+enum MemTag:uint8_t{ MemOther, MemFov, MemPath, MemAi, MemRender, MemLog, MemSave, MemLevel, MemTagCount };
+#ifdef ASCIIROGUE_MEMTAGS
+inline constexpr const char* mem_tag_names[MemTagCount]={"other","fov","path","ai","render","log","save","level"};
+struct MemStats{ std::atomic<int64_t> live{0}, peak{0}; std::atomic<uint64_t> allocs{0}, turn{0}; uint64_t last_turn=0, max_turn=0; };
+inline MemStats* mem_stats(){ static MemStats s[MemTagCount]; return s; }
+inline MemTag& mem_tag(){ thread_local MemTag t=MemOther; return t; }
+struct MemScope{ MemTag prev; explicit MemScope(MemTag t):prev(mem_tag()){ mem_tag()=t; } ~MemScope(){ mem_tag()=prev; } };
+inline void mem_alloc(MemTag t, size_t n){
+    MemStats& m=mem_stats()[t]; m.allocs.fetch_add(1,std::memory_order_relaxed); m.turn.fetch_add(1,std::memory_order_relaxed);
+    int64_t live=m.live.fetch_add((int64_t)n,std::memory_order_relaxed)+(int64_t)n, peak=m.peak.load(std::memory_order_relaxed);
+    while(live>peak && !m.peak.compare_exchange_weak(peak,live,std::memory_order_relaxed)){}
+}
+inline void mem_free(MemTag t, size_t n){ mem_stats()[t].live.fetch_sub((int64_t)n,std::memory_order_relaxed); }
+// Per-tag totals: allocations overall, in the last turn and in the busiest turn, plus live and peak bytes.
+inline void mem_report(std::ostream& os){
+    os<<std::left<<std::setw(8)<<"tag"<<std::right<<std::setw(12)<<"allocs"<<std::setw(11)<<"last turn"<<std::setw(11)<<"max turn"<<std::setw(14)<<"live bytes"<<std::setw(14)<<"peak bytes"<<"\n";
+    for(int i=0;i<MemTagCount;i++){ MemStats& m=mem_stats()[i];
+        os<<std::left<<std::setw(8)<<mem_tag_names[i]<<std::right<<std::setw(12)<<m.allocs.load()<<std::setw(11)<<m.last_turn<<std::setw(11)<<m.max_turn<<std::setw(14)<<m.live.load()<<std::setw(14)<<m.peak.load()<<"\n"; }
+}
+#else
+struct MemScope{ explicit MemScope(MemTag){} };
+#endif
+
+inline void end_frame(){
+    State& s=state(); FrameEv f{since_epoch_us(Clock::now()),{}};
+    for(int i=0;i<PhaseCount;i++) s.last_ns[i]=s.ns[i].exchange(0);
+    for(int i=0;i<CounterCount;i++) f.cnt[i]=s.last_cnt[i]=s.cnt[i].exchange(0);
+#ifdef ASCIIROGUE_MEMTAGS
+    for(int i=0;i<MemTagCount;i++){ MemStats& m=mem_stats()[i]; m.last_turn=m.turn.exchange(0); m.max_turn=std::max(m.max_turn,m.last_turn); }
+#endif
+    if(s.tracing){ std::lock_guard<std::mutex> lk(s.mu); s.frames.push_back(f); }
+}
+// Overlay rows: last frame's phase times and counters; with MEMTAGS, then live/peak KiB per tag, wrapped to width.
+inline std::vector<std::string> overlay(int width){
+    State& s=state(); std::ostringstream o;
+    for(int i=0;i<PhaseCount;i++) o<<phase_short[i]<<" "<<s.last_ns[i]/1000<<" ";
+    o<<"us |";
+    for(int i=0;i<CounterCount;i++) o<<" "<<counter_short[i]<<" "<<s.last_cnt[i];
+    std::vector<std::string> rows{o.str()};
+#ifdef ASCIIROGUE_MEMTAGS
+    rows.back()+=" |"; for(int i=0;i<MemTagCount;i++) if(mem_stats()[i].last_turn) rows.back()+=" "+std::string(mem_tag_names[i])+" "+std::to_string(mem_stats()[i].last_turn);
+    rows.emplace_back("KiB live/peak:");
+    for(int i=0;i<MemTagCount;i++){
+        std::string item=std::string(" ")+mem_tag_names[i]+" "+std::to_string(mem_stats()[i].live.load()/1024)+"/"+std::to_string(mem_stats()[i].peak.load()/1024);
+        if((int)(rows.back().size()+item.size())>width) rows.emplace_back(" ");
+        rows.back()+=item;
+    }
+#else
+    (void)width;
+#endif
+    return rows;
+}
+inline bool write_trace(const std::string& path){
+    State& s=state(); std::ofstream f(path); if(!f) return false;
+    std::lock_guard<std::mutex> lk(s.mu);
+    f<<"{\"traceEvents\":[\n"; bool first=true;
+    auto sep=[&]{ if(!first) f<<",\n"; first=false; };
+    for(auto& e: s.trace){ sep(); f<<"{\"name\":\""<<phase_names[e.phase]<<"\",\"ph\":\"X\",\"pid\":1,\"tid\":"<<e.tid<<",\"ts\":"<<e.ts_us<<",\"dur\":"<<e.dur_us<<"}"; }
+    for(auto& fr: s.frames){ sep(); f<<"{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":"<<fr.ts_us<<",\"args\":{";
+        for(int i=0;i<CounterCount;i++) f<<(i?",":"")<<"\""<<counter_names[i]<<"\":"<<fr.cnt[i];
+        f<<"}}"; }
+    f<<"\n],\"displayTimeUnit\":\"ms\"}\n";
+    return (bool)f;
+}
+// Forwards to the real stdout buffer, counting bytes that reach the terminal.
+struct CountingBuf: std::streambuf{
+    std::streambuf* inner; char buf[4096];
+    explicit CountingBuf(std::streambuf* in):inner(in){ setp(buf,buf+sizeof buf); }
+    ~CountingBuf() override { drain(); }
+    void drain(){ std::ptrdiff_t n=pptr()-pbase(); if(n>0){ inner->sputn(pbase(),n); count(TermBytes,(uint64_t)n); } setp(buf,buf+sizeof buf); }
+    int overflow(int ch) override { drain(); if(ch!=traits_type::eof()){ *pptr()=(char)ch; pbump(1); } return traits_type::not_eof(ch); }
+    int sync() override { drain(); return inner->pubsync(); }
+};
+} // namespace prof
+
+struct Pos;
+// Forward declarations
+struct Pos;
+struct Game;
+void ai_turn(Game& g);
+void process_statuses(Game& g);
+void world_tick(Game& g);
+
+// ---------------- RNG ----------------
+struct RNG{ std::mt19937_64 eng; RNG():eng(std::random_device{}()){} explicit RNG(uint64_t s):eng(s){} int i(int lo,int hi){ std::uniform_int_distribution<int>d(lo,hi);
+ return d(eng);
+} double d(double lo,double hi){ std::uniform_real_distribution<double>d(lo,hi);
+ return d(eng);
+} bool chance(double p){ std::bernoulli_distribution b(p);
+ return b(eng);
+} };
+// Cheap splitmix64 stream for per-mob decisions; seeded from RNG so parallel planning stays reproducible.
+struct FastRNG{ uint64_t s=0; uint64_t next(){ uint64_t z=(s+=0x9e3779b97f4a7c15ULL); z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL; z=(z^(z>>27))*0x94d049bb133111ebULL; return z^(z>>31); }
+ int i(int lo,int hi){ return lo+(int)(next()%(uint64_t)(hi-lo+1)); }
+ bool chance(double p){ return (next()>>11)*(1.0/9007199254740992.0) < p; } };
+
+// ---------------- Basics ----------------
+struct Pos{ int r=0,c=0; };
+inline bool operator==(const Pos&a,const Pos&b){ return a.r==b.r && a.c==b.c; }
+constexpr Pos kDir4[4]={{-1,0},{1,0},{0,-1},{0,1}}; // N S W E
+inline bool operator!=(const Pos&a,const Pos&b){ return !(a==b); }
+struct Rect{ int r=0,c=0,h=0,w=0; };
+
+// ---------------- Threads ----------------
+// Every helper thread starts with SIGWINCH blocked (a thread inherits its creator's mask), so a resize
+// always lands on the main thread, where it breaks the blocking key read.
+template<class F> std::thread spawn_worker(F&& f){
+#ifdef _WIN32
+    return std::thread(std::forward<F>(f));
+#else
+    sigset_t only, old; sigemptyset(&only); sigaddset(&only,SIGWINCH);
+    pthread_sigmask(SIG_BLOCK,&only,&old);
+    struct Restore{ sigset_t m; ~Restore(){ pthread_sigmask(SIG_SETMASK,&m,nullptr); } } restore{old};
+    return std::thread(std::forward<F>(f));
+#endif
+}
+
+// ---------------- Arenas ----------------
+// Bump allocator behind std::pmr containers. deallocate is a no-op: memory comes back all at once when
+// the arena is rewound to a Mark or reset. Blocks are kept for reuse, so a warm arena never calls new.
+class Arena: public std::pmr::memory_resource{
+public:
+    struct Mark{ size_t blk=0, off=0; };
+    explicit Arena(size_t block):block_(block){}
+    Arena(const Arena&)=delete; Arena& operator=(const Arena&)=delete;
+    ~Arena() override { for(auto& b: blocks_) ::operator delete(b.p); }
+    Mark mark() const { return {cur_,off_}; }
+    void rewind(Mark m){ cur_=m.blk; off_=m.off; }
+    void reset(){ rewind({}); }
+    size_t reserved() const { size_t n=0; for(auto& b: blocks_) n+=b.n; return n; }
+private:
+    struct Block{ std::byte* p; size_t n; };
+    std::vector<Block> blocks_; size_t cur_=0, off_=0, block_;
+    void* do_allocate(size_t n, size_t align) override {
+        for(;;){
+            if(cur_<blocks_.size()){
+                Block& b=blocks_[cur_];
+                size_t at=(size_t)(((uintptr_t)b.p+off_+align-1)&~(uintptr_t)(align-1))-(uintptr_t)b.p;
+                if(at+n<=b.n){ off_=at+n; return b.p+at; }
+                cur_++; off_=0;
+                if(cur_<blocks_.size() && blocks_[cur_].n>=n+align) continue;
+            }
+            // no kept block fits: slot a new one in here; blocks past cur_ are free, so no Mark moves
+            size_t sz=std::max(block_,n+align);
+            blocks_.insert(blocks_.begin()+cur_, Block{(std::byte*)::operator new(sz), sz}); off_=0;
+        }
+    }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override { return this==&o; }
+};
+Arena& scratch();
+struct ScratchScope{
+    Arena& a; Arena::Mark m;
+    ScratchScope():a(scratch()),m(a.mark()){}
+    ~ScratchScope(){ a.rewind(m); }
+    std::pmr::memory_resource* operator*() const { return &a; }
+};
+
+// ---------------- Tiles ----------------
+enum class Tile:int{ Wall=0, Floor=1, StairsDown=2, DoorClosed=3, DoorOpen=4, TrapHidden=5, TrapRevealed=6, SecretWall=7, Teleporter=8};
+struct Cell{ Tile t=Tile::Wall; bool visible=false, seen=false; };
+enum class Color:int { Default=0, Wall, Floor, Stairs, Door, Trap, Item, Chest, Mob, Player, Boss, Teleporter, Legend,
+    WallLava, FloorLava, WallSewer, FloorSewer, WallLibrary, FloorLibrary, WallArmory, FloorArmory }; // biome tints last
+// Grid shape: runtime for loaded or odd sizes, compile-time for FixedMap so the stride folds to a constant.
+struct DynShape{ int H=24,W=80; DynShape(int h,int w):H(h),W(w){} };
+template<int HH,int WW> struct FixedShape{ static constexpr int H=HH, W=WW; FixedShape(int,int){} };
+// Cells live in an (H+2)x(W+2) block with a ring of sentinel walls around the map: at() is valid for
+// r in [-1,H], c in [-1,W], so neighbour reads from any in-bounds cell need no in() check.
+template<class Shape> struct BasicMap: Shape{
+    std::vector<Cell> g;
+    BasicMap(int h,int w):Shape(h,w),g((size_t)(this->H+2)*(this->W+2)){}
+    int stride() const { return this->W+2; }
+    size_t idx(int r,int c) const { return (size_t)(r+1)*stride()+(c+1); }
+    Cell& at(int r,int c){ return g[idx(r,c)]; }
+    const Cell& at(int r,int c) const { return g[idx(r,c)]; }
+    bool in(int r,int c) const { return r>=0&&c>=0&&r<this->H&&c<this->W; }
+    bool passable(int r,int c) const { Tile t=at(r,c).t; return !(t==Tile::Wall||t==Tile::DoorClosed||t==Tile::SecretWall); } // ring-safe, no bounds check
+    bool walkable(int r,int c) const { return in(r,c) && passable(r,c); }
+    void resetFOV(){ for(auto&x:g){ x.visible=false; } }
+    void clear(){ std::fill(g.begin(),g.end(),Cell{}); }
+};
+using Map=BasicMap<DynShape>;
+template<int H,int W> using FixedMap=BasicMap<FixedShape<H,W>>;
+
+// ---------------- Entities/Items ----------------
+enum class ItemKind{
+    PotionHeal,PotionStr,PotionAntidote,PotionRegen,
+    Dagger,Sword,
+    ArmorLeather,ArmorChain,
+    Key,
+    SpellbookFirebolt,SpellbookHeal,SpellbookBlink,SpellbookIce,SpellbookShield,SpellbookFireball,
+    ScrollBlink,ScrollMapping,
+    Bomb
+};
+enum class AiKind{ Wander,Hunter };
+enum class EntityType{ Player,Mob,ItemEntity,Chest,Merchant,BombPlaced };
+enum class SpellKind{ Firebolt,Heal,Blink,IceShard,Shield,Fireball };
+enum class TrapKind{ Spike,Fire,Snare,Poison,Teleport,Explosive };
+enum FxKind:int{ FxBurn=0, FxPoison, FxRegen, FxSnare, FxShield, FxCount };
+struct Stats{
+    int max_hp=20,hp=20;
+    int atk=3,def=1,str=10;
+    int max_mp=10,mp=10;
+};
+// The player's status timers (Game::pstat) live in one small array so a tick is a single branch-light pass;
+// bit k of mask is set while fx[k]>0. Mobs carry none of this: afflicted ones have a row in Game::status.
+struct PlayerStatus{ std::array<int16_t,FxCount> fx{}; uint8_t mask=0; int shield_bonus=0; };
+
+// ---------------- Biomes ----------------
+// Everything a biome changes is one row of kBiomes, looked up by id; nothing compares biome names at runtime.
+enum class Biome:uint8_t{ Default, Crypt, Catacombs, Armory, LavaCaves, Sewers, Library };
+constexpr int kBiomeCount=(int)Biome::Library+1;
+enum class LevelGen:uint8_t{ Rooms, Caves, Bsp };
+struct BiomeSpec{
+    const char* name;
+    LevelGen gen; double trap_rate;
+    TrapKind trap_a, trap_b; double p_trap_a; // a hidden trap is trap_a with p_trap_a, else trap_b
+    Color wall, floor;
+    const char* favored; // monster glyphs spawned at kFavoredWeight
+};
+constexpr int kFavoredWeight=3;
+constexpr BiomeSpec kBiomes[kBiomeCount]={
+    {"Default",   LevelGen::Rooms, 0.04, TrapKind::Spike,  TrapKind::Snare,     0.5, Color::Wall,        Color::Floor,        ""},
+    {"Crypt",     LevelGen::Rooms, 0.04, TrapKind::Spike,  TrapKind::Snare,     0.5, Color::Wall,        Color::Floor,        "zZGW"},
+    {"Catacombs", LevelGen::Rooms, 0.05, TrapKind::Spike,  TrapKind::Snare,     0.5, Color::Wall,        Color::Floor,        "zZrx"},
+    {"Armory",    LevelGen::Bsp,   0.04, TrapKind::Spike,  TrapKind::Snare,     0.6, Color::WallArmory,  Color::FloorArmory,  "ogp"},
+    {"Lava Caves",LevelGen::Caves, 0.08, TrapKind::Fire,   TrapKind::Explosive, 0.5, Color::WallLava,    Color::FloorLava,    "ihF"},
+    {"Sewers",    LevelGen::Caves, 0.04, TrapKind::Poison, TrapKind::Teleport,  0.5, Color::WallSewer,   Color::FloorSewer,   "rjwsc"},
+    {"Library",   LevelGen::Bsp,   0.04, TrapKind::Snare,  TrapKind::Spike,     0.6, Color::WallLibrary, Color::FloorLibrary, "hpW"},
+};
+constexpr const BiomeSpec& biome_spec(Biome b){ return kBiomes[(int)b]; }
+
+// ---------------- Prototypes ----------------
+// Immutable per-kind data: name, glyph, base numbers, price, description. Monster and Item instances
+// hold only a prototype id plus what was rolled for them, so spawning, combat and the codex never copy
+// or hash a name.
+constexpr int kItemKindCount=(int)ItemKind::Bomb+1;
+struct ItemProto{ ItemKind kind; std::string name; char glyph; int power_lo=0, power_hi=0; int price=5; std::string desc; bool desc_power=false; };
+struct MonsterProto{ std::string name; char glyph; int hp=0, atk=0, def=0; }; // stat bonuses on top of the level roll
+// Fixed monster slots; everything from MonFirstRandom on is fair game for make_mon.
+enum : uint16_t{ MonPlayer=0, MonGuardian=1, MonFirstRandom=2 };
+struct LootEntry{ ItemKind kind; int weight; };
+struct BiomeEntry{ Biome id; int weight=1; };
+struct Content{
+    std::vector<MonsterProto> mons; std::vector<ItemProto> items; std::vector<LootEntry> loot;
+    std::vector<BiomeEntry> biomes; std::vector<std::string> tips;
+    // derived by index()
+    int loot_total=0, biome_total=0; std::array<std::vector<uint16_t>,kItemKindCount> items_of_kind;
+    std::array<std::vector<uint32_t>,kBiomeCount> mon_cdf; // per biome, cumulative spawn weight over mons[MonFirstRandom..]
+    std::unordered_map<std::string,uint16_t> mon_by_name, item_by_name; // save/load lookups only
+    void index(){
+        loot_total=0; for(auto& l: loot) loot_total+=l.weight;
+        biome_total=0; for(auto& b: biomes) biome_total+=b.weight;
+        for(auto& v: items_of_kind) v.clear();
+        mon_by_name.clear(); item_by_name.clear();
+        for(size_t i=0;i<items.size();i++){ items_of_kind[(int)items[i].kind].push_back((uint16_t)i); item_by_name.emplace(items[i].name,(uint16_t)i); }
+        for(size_t i=0;i<mons.size();i++) mon_by_name.emplace(mons[i].name,(uint16_t)i);
+        for(int b=0;b<kBiomeCount;b++){
+            auto& cdf=mon_cdf[b]; cdf.clear(); uint32_t sum=0; const char* fav=kBiomes[b].favored;
+            for(size_t i=MonFirstRandom;i<mons.size();i++){ sum+=std::strchr(fav,mons[i].glyph)? kFavoredWeight : 1; cdf.push_back(sum); }
+        }
+    }
+};
+const Content& content();
+void install_content(Content c);
+
+// ---------------- Content packs ----------------
+// Text pack, parsed and validated once at startup. One record per line, '#' starts a comment; a pack
+// replaces each builtin table it has records for and leaves the others alone.
+//   monster <glyph> <hp> <atk> <def> <name...>   (bonuses on the level roll; hp >= -5, atk >= -1, def >= 0)
+//   item    <Kind> <glyph> <power_lo> <power_hi> <price> <show_power 0|1> <name...> | <description>
+//   loot    <Kind> <weight>
+//   biome   <weight> <name...>          (one of the builtin biome names; sets how often it is picked)
+//   tip     <text...>
+// --dump-content writes the builtin tables in this format as a starting point.
+inline constexpr const char* kItemKindNames[kItemKindCount]={
+    "PotionHeal","PotionStr","PotionAntidote","PotionRegen","Dagger","Sword","ArmorLeather","ArmorChain","Key",
+    "SpellbookFirebolt","SpellbookHeal","SpellbookBlink","SpellbookIce","SpellbookShield","SpellbookFireball",
+    "ScrollBlink","ScrollMapping","Bomb"};
+bool load_content_pack(const std::string& path, Content& out, std::string& err);
+void dump_content(const Content& c, std::ostream& os);
+struct Item{ uint16_t proto=0; int power=0;
+    const ItemProto& data() const { return content().items[proto]; }
+    ItemKind kind() const { return data().kind; }
+    const std::string& name() const { return data().name; }
+    char glyph() const { return data().glyph; }
+};
+struct Inventory{
+    std::vector<Item> items; int weapon_idx=-1, armor_idx=-1; int keys=0; std::vector<SpellKind> spells; std::unordered_map<int,int> mastery;
+    bool knows(SpellKind s) const { return std::find(spells.begin(),spells.end(),s)!=spells.end(); }
+    int boost(SpellKind s) const { auto it=mastery.find((int)s); return it==mastery.end()?0:it->second; }
+    void learn(SpellKind s){ if(!knows(s)) spells.push_back(s); mastery[(int)s]++; }
+};
+struct Monster{ uint16_t proto=MonPlayer; Stats st; AiKind ai=AiKind::Wander; bool alive=true; bool slain=false; int fx_row=-1; int xp=5; int speed=100; int energy=0; int dormant_since=-1;
+    const std::string& name() const { return content().mons[proto].name; }
+    char glyph() const { return content().mons[proto].glyph; }
+};
+struct Chest{ bool locked=true; bool opened=false; Item content{}; };
+struct Entity{
+    EntityType type=EntityType::Mob; Pos pos; bool blocks=true;
+    Monster mob; Item item; Chest chest; int fuse=0;
+    uint32_t id=0; bool gone=false; // id: stable handle (ascending in g.ents); gone: consumed, awaiting compaction
+};
+// Emitted by compaction for every mob removed from g.ents; credited kills feed XP and the codex.
+struct KillEvent{ uint32_t id=0; uint16_t mon=0; int xp=0; Pos pos; bool credited=false; };
+// Damage/affliction record queued by producers and applied in one pass by resolve_events().
+// target/src index g.ents (-1 = player); indices hold until compaction, which runs after the last resolve of a turn.
+enum class Cause:uint8_t{ Melee, Explosion, Firebolt, IceShard, Fireball, Trap, Ailment };
+struct CombatEvent{ int target=-1, src=-1; int16_t dmg=0, burn=0, snare=0, poison=0; Cause cause=Cause::Melee; };
+// Per-tile intrusive lists of g.ents indices. Kept in sync by spawn()/move_ent(), rebuilt by compaction.
+struct SpatialIndex{
+    int W=0; std::pmr::vector<int> head, next;
+    explicit SpatialIndex(std::pmr::memory_resource* mr=std::pmr::get_default_resource()):head(mr),next(mr){}
+    void reset(int h,int w){ W=w; head.assign((size_t)h*w,-1); next.clear(); }
+    void link(int i,Pos p){ if((int)next.size()<=i) next.resize(i+1,-1); int k=p.r*W+p.c; next[i]=head[k]; head[k]=i; }
+    void unlink(int i,Pos p){ int* pp=&head[p.r*W+p.c]; while(*pp!=-1 && *pp!=i) pp=&next[*pp]; if(*pp==i) *pp=next[i]; }
+    int first(int r,int c) const { return head[r*W+c]; }
+};
+// Burning ground: per-tile TTL grid plus a dense list of live tiles, swap-removed on expiry.
+struct HazardLayer{
+    int W=0; std::pmr::vector<uint8_t> ttl; std::pmr::vector<int> slot, active; // slot: position in active, -1 if cold
+    explicit HazardLayer(std::pmr::memory_resource* mr=std::pmr::get_default_resource()):ttl(mr),slot(mr),active(mr){}
+    void reset(int h,int w){ W=w; ttl.assign((size_t)h*w,0); slot.assign((size_t)h*w,-1); active.clear(); }
+    // Overlapping fire merges into the stronger burn instead of stacking duplicate zones.
+    void ignite(int r,int c,int t){ int k=r*W+c; if(slot[k]<0){ slot[k]=(int)active.size(); active.push_back(k); } ttl[k]=(uint8_t)std::max<int>(ttl[k],std::min(t,255)); }
+    void extinguish(size_t j){ int k=active[j], last=active.back(); active[j]=last; slot[last]=(int)j; active.pop_back(); ttl[k]=0; slot[k]=-1; }
+    bool at(int r,int c) const { return ttl[r*W+c]>0; }
+};
+// Status timers of afflicted mobs as parallel columns, one row per mob, so a tick is one pass per timer over
+// every row with no per-mob branching. Rows are swap-removed once a mob's timers run out; Monster::fx_row points back.
+struct StatusTable{
+    using Col=std::pmr::vector<int16_t>;
+    static_assert(FxCount==5,"one Col per FxKind");
+    std::pmr::vector<int> ent; // g.ents index, -1 while awaiting removal
+    Col live;                   // 1 while the row ticks (mob alive and not dormant), else 0
+    std::array<Col,FxCount> fx;
+    explicit StatusTable(std::pmr::memory_resource* mr=std::pmr::get_default_resource())
+        :ent(mr),live(mr),fx{{Col(mr),Col(mr),Col(mr),Col(mr),Col(mr)}}{}
+    size_t size() const { return ent.size(); }
+    int add(int i){ ent.push_back(i); live.push_back(0); for(auto& c: fx) c.push_back(0); return (int)ent.size()-1; }
+    bool any(size_t j) const { int16_t m=0; for(auto& c: fx) m|=(int16_t)(c[j]>0); return m!=0; }
+    // swap-remove; returns the g.ents index of the row that moved into j, or -1
+    int remove(size_t j){
+        size_t b=ent.size()-1; ent[j]=ent[b]; live[j]=live[b]; for(auto& c: fx) c[j]=c[b];
+        ent.pop_back(); live.pop_back(); for(auto& c: fx) c.pop_back();
+        return j<b? ent[j] : -1;
+    }
+};
+
+// ---------------- Game ----------------
+// Renderer's cache of each cell's glyph/color. key = 1+(tile,visible,seen) when last refreshed, 0 = never;
+// a cell is only re-looked-up when its key changes, so no mutation site has to mark anything dirty.
+struct TileLayer{ int W=0; Biome biome=Biome::Default; std::vector<uint8_t> key; std::vector<char> ch; std::vector<Color> col; };
+struct Options{ bool auto_open_on_bump=true; bool auto_pickup_keys=true; int wake_radius=24; };
+// Ring of the last kKeep messages. Slots are overwritten in place and start with room for a screen-wide
+// line, so logging a message (add({...}) joins the parts straight into the slot) doesn't allocate.
+struct Log{ static constexpr int kKeep=200, kLineCap=96;
+ std::vector<std::string> ring; size_t n=0; // n: messages ever added
+ Log(){ prof::MemScope mt(prof::MemLog); ring.resize(kKeep); for(auto& l: ring) l.reserve(kLineCap); }
+ std::string& next(){ return ring[n++%kKeep]; }
+ void add(std::string_view s){ next().assign(s); }
+ void add(std::initializer_list<std::string_view> parts){ std::string& l=next(); l.clear(); for(auto p: parts) l.append(p); }
+ void render(int H,int W,std::ostream& os=std::cout) const {
+ size_t start= n>3? n-3 : 0;
+ for(int i=0;i<3;i++){ size_t idx=start+i; io::move(H-3+i,0,os);
+ std::string_view row= idx<n? std::string_view(ring[idx%kKeep]) : std::string_view();
+ if((int)row.size()>W) row=row.substr(0,W);
+ os<<row<<std::string(W-row.size(),' '); } } };
+struct Game{
+    // level storage: ents, events, status, grid and fire draw from here; release_level() drops it in one step
+    std::unique_ptr<Arena> level_mem=std::make_unique<Arena>(256<<10);
+    Map map; RNG rng; int level=1,max_level=8; Biome biome=Biome::Default;
+    Entity player; PlayerStatus pstat; Inventory inv; std::pmr::vector<Entity> ents{level_mem.get()}; Log log; bool running=true; int gold=0;
+    uint32_t next_id=1; bool ents_dirty=false; std::vector<KillEvent> kill_events; SpatialIndex grid{level_mem.get()};
+    std::pmr::vector<CombatEvent> events{level_mem.get()}; std::function<void(const CombatEvent&)> event_sink; // sink: replay/telemetry tap
+    StatusTable status{level_mem.get()}; // timers of afflicted mobs; the only mobs process_statuses visits
+    Pos teleporter{ -1, -1 };
+    
+    HazardLayer fire{level_mem.get()}; TileLayer tiles;
+// camera
+    int cam_r=0, cam_c=0; bool cam_follow=true; bool show_prof=false;
+    int scr_h=24, scr_w=80; // terminal size; the viewport is cut from this, independent of the map
+    struct Presenter* presenter=nullptr; // async render thread (main --async-render); null draws inline
+    // meta
+    int xp=0, plv=1; std::vector<int> kills; // by monster prototype
+    Options opt;
+    // AI activation: walk distance from the player, valid where wake_stamp==turn
+    int turn=0; std::vector<int> wake_dist; std::vector<int> wake_stamp;
+    Game(int h=24,int w=80): map(h,w) { grid.reset(h,w); fire.reset(h,w); } // spawn() is valid before the first level
+    // Moving constructs the level containers with the arena they already point at. Assignment would free the
+    // old arena (level_mem goes first) while ents & co. still referenced it, so it is not offered.
+    Game(Game&&)=default;
+    Game& operator=(Game&&)=delete;
+    Game& operator=(const Game&)=delete;
+};
+void release_level(Game& g);
+
+// ---------------- Entity lifecycle ----------------
+Entity& spawn(Game& g, Entity e);
+// Visits each entity within `radius` of c once (Manhattan diamond, or Chebyshev square); cost tracks the area, not g.ents.
+template<class F> void for_each_in_area(const Game& g, Pos c, int radius, bool square, F&& f){
+    for(int r=std::max(0,c.r-radius); r<=std::min(g.map.H-1,c.r+radius); ++r){
+        int span = square? radius : radius-std::abs(r-c.r);
+        for(int cc=std::max(0,c.c-span); cc<=std::min(g.map.W-1,c.c+span); ++cc)
+            for(int i=g.grid.first(r,cc); i!=-1; i=g.grid.next[i]) f(i);
+    }
+}
+
+// ---------------- Combat events ----------------
+void post(Game& g, const CombatEvent& ev);
+
+// ---------------- Helpers ----------------
+// Ring-safe: (r,c) may be anywhere in [-1,H]x[-1,W]; the sentinel ring reads as wall.
+template<class M> bool opaque(const M& m,int r,int c){ Tile t=m.at(r,c).t; return t==Tile::Wall || t==Tile::DoorClosed || t==Tile::SecretWall; }
+char tile_glyph(const Cell& cell);
+template<class M> void set_visible(M&m,int r,int c){ Cell& x=m.at(r,c); x.visible=true; x.seen=true; }
+template<class M> bool los_block(const M&m,int r,int c){ return opaque(m,r,c); }
+
+// ---------------- Ray tables ----------------
+// Bresenham rays from the origin to every offset in the radius-kRayRadius diamond, merged into one prefix
+// tree and stored in preorder. A walk tests each cell once for all the rays through it, and a blocked
+// cell jumps to skip, past its whole subtree. Built at compile time; nothing is rasterized at runtime.
+constexpr int kRayRadius=12, kRaySpan=2*kRayRadius+1, kRayMaxNodes=1024;
+struct RayNode{ int8_t dr=0, dc=0; uint8_t reach=0; uint16_t skip=0, parent=0; }; // reach: nearest target distance in the subtree
+struct RayTable{ RayNode node[kRayMaxNodes]; int n=0; uint16_t end_of[kRaySpan*kRaySpan]; };
+constexpr int ray_slot(int dr,int dc){ return (dr+kRayRadius)*kRaySpan+(dc+kRayRadius); }
+constexpr RayTable build_rays(){
+    // pass 1: trie in insertion order (parents before children)
+    RayNode t[kRayMaxNodes]{}; int16_t first[kRayMaxNodes]{}, sib[kRayMaxNodes]{}; uint16_t end_raw[kRaySpan*kRaySpan]{}; int n=1;
+    for(int i=0;i<kRayMaxNodes;i++){ first[i]=-1; sib[i]=-1; }
+    t[0].reach=0;
+    for(int tr=-kRayRadius;tr<=kRayRadius;tr++) for(int tc=-kRayRadius;tc<=kRayRadius;tc++){
+        int dist=(tr<0?-tr:tr)+(tc<0?-tc:tc); if(dist>kRayRadius) continue;
+        int x=0,y=0, dx=tr<0?-tr:tr, sx=0<tr?1:-1, dy=-(tc<0?-tc:tc), sy=0<tc?1:-1, err=dx+dy, cur=0;
+        while(x!=tr || y!=tc){
+            int e2=2*err;
+            if(e2>=dy){ err+=dy; x+=sx; }
+            if(e2<=dx){ err+=dx; y+=sy; }
+            int k=first[cur]; while(k>=0 && !(t[k].dr==x && t[k].dc==y)) k=sib[k];
+            if(k<0){ k=n++; t[k].dr=(int8_t)x; t[k].dc=(int8_t)y; t[k].reach=255; t[k].parent=(uint16_t)cur; sib[k]=first[cur]; first[cur]=(int16_t)k; }
+            if(t[k].reach>dist) t[k].reach=(uint8_t)dist;
+            cur=k;
+        }
+        end_raw[ray_slot(tr,tc)]=(uint16_t)cur;
+    }
+    // pass 2: subtree sizes, then preorder positions handed out parent-first
+    int size[kRayMaxNodes]{}, pos[kRayMaxNodes]{};
+    for(int i=0;i<n;i++) size[i]=1;
+    for(int i=n-1;i>0;i--) size[t[i].parent]+=size[i];
+    for(int i=0;i<n;i++){ int at=pos[i]+1; for(int k=first[i];k>=0;k=sib[k]){ pos[k]=at; at+=size[k]; } }
+    RayTable out{};
+    out.n=n;
+    for(int i=0;i<n;i++){ RayNode q=t[i]; q.skip=(uint16_t)(pos[i]+size[i]); q.parent=(uint16_t)pos[t[i].parent]; out.node[pos[i]]=q; }
+    for(int i=0;i<kRaySpan*kRaySpan;i++) out.end_of[i]=(uint16_t)pos[end_raw[i]];
+    return out;
+}
+constexpr RayTable kRays=build_rays();
+static_assert(kRays.n<kRayMaxNodes, "raise kRayMaxNodes");
+// radius is capped at kRayRadius. Rays run from one in-bounds cell outward, so the sentinel ring stops
+// any ray that would leave the map (the ring cell itself gets marked, which nothing reads).
+template<class M> void compute_fov(M&m,int cx,int cy,int radius){
+    prof::Scope ps(prof::Fov); prof::Tally cells(prof::FovCells); prof::MemScope mt(prof::MemFov);
+    m.resetFOV();
+    set_visible(m,cx,cy);
+    radius=std::min(radius,kRayRadius);
+    for(int i=1;i<kRays.n;){
+        const RayNode& q=kRays.node[i];
+        if(q.reach>radius){ i=q.skip; continue; }
+        int r=cx+q.dr, c=cy+q.dc;
+        set_visible(m,r,c); cells.n++;
+        i= los_block(m,r,c)? q.skip : i+1;
+    }
+}
+
+// ---------------- Pathfinding ----------------
+struct PQE{ int f,g,r,c; };
+// Shortest 4-way path s..t into the caller's buffer (cleared first; empty when t is unreachable). Keep the
+// buffer across calls and a search allocates nothing once it has grown.
+template<class M> bool astar(const M&m,Pos s,Pos t,std::vector<Pos>& path){
+    path.clear();
+    prof::Scope ps(prof::Astar); prof::Tally nodes(prof::AstarNodes); prof::MemScope mt(prof::MemPath);
+    auto h=[&](int r,int c){ return std::abs(r-t.r)+std::abs(c-t.c); };
+    auto cmp=[](const PQE&a,const PQE&b){ return a.f>b.f || (a.f==b.f && a.g<b.g); };
+    ScratchScope mem;
+    std::pmr::vector<PQE> open(*mem);
+    std::pmr::unordered_map<long long,std::pair<int,int>> parent(*mem); std::pmr::unordered_set<long long> inOpen(*mem); std::pmr::unordered_map<long long,int> bestG(*mem);
+    auto key=[&](int r,int c)->long long{ return ((long long)r<<32)^(unsigned)c; };
+    auto push=[&](int r,int c,int g){ PQE e{g+h(r,c),g,r,c}; open.push_back(e);
+ std::push_heap(open.begin(),open.end(),cmp);
+ inOpen.insert(key(r,c));
+ };
+    push(s.r,s.c,0); bestG[key(s.r,s.c)]=0;
+    while(!open.empty()){
+        std::pop_heap(open.begin(),open.end(),cmp);
+ PQE cur=open.back();
+ open.pop_back(); nodes.n++;
+ inOpen.erase(key(cur.r,cur.c));
+
+        if(cur.r==t.r && cur.c==t.c){ long long k=key(t.r,t.c);
+ while(true){ path.push_back({(int)(k>>32),(int)(k&0xffffffff)});
+ auto it=parent.find(k);
+ if(it==parent.end()) break; k=((long long)it->second.first<<32)^(unsigned)it->second.second; } std::reverse(path.begin(),path.end());
+ return true; }
+        for(Pos d: kDir4){ Pos nb{cur.r+d.r,cur.c+d.c};
+            if(!m.passable(nb.r,nb.c)) continue; int ng=cur.g+1; long long nk=key(nb.r,nb.c);
+            auto it=bestG.find(nk);
+ if(it==bestG.end()||ng<it->second){ bestG[nk]=ng; parent[nk]={cur.r,cur.c}; if(!inOpen.count(nk)) push(nb.r,nb.c,ng);
+ }
+        }
+    }
+    return false;
+}
+
+// ---------------- Gen helpers ----------------
+bool rect_overlap(const Rect&a,const Rect&b);
+
+// ---------------- Items/Monsters ----------------
+Item make_random_item(RNG&rng);
+std::string item_desc(const Item& it);
+Monster make_mon(RNG&rng,int level,Biome biome=Biome::Default);
+
+// ---------------- Generation ----------------
+// Rooms filed by coarse grid bucket, so an overlap query only looks at rooms near the candidate.
+struct RoomHash{
+    static constexpr int kCell=16;
+    int cols=0; std::vector<std::vector<int>> bucket;
+    RoomHash(int h,int w):cols(w/kCell+1),bucket((size_t)(h/kCell+1)*cols){}
+    template<class F> void each_bucket(const Rect& t, F f){
+        for(int br=t.r/kCell; br<=(t.r+t.h-1)/kCell; br++) for(int bc=t.c/kCell; bc<=(t.c+t.w-1)/kCell; bc++) f(bucket[(size_t)br*cols+bc]);
+    }
+    void add(const Rect& t, int id){ each_bucket(t,[&](std::vector<int>& b){ b.push_back(id); }); }
+    bool overlaps(const Rect& t, const std::vector<Rect>& R){
+        bool hit=false; each_bucket(t,[&](std::vector<int>& b){ for(int id: b) if(!hit && rect_overlap(t,R[id])) hit=true; });
+        return hit;
+    }
+};
+std::vector<Rect> gen_bsp(Map& m,RNG& rng);
+// Cave grid for ca_step: 64 cells per word, bit set = wall.
+struct Bitboard{
+    int H=0,W=0,NW=0; std::vector<uint64_t> w;
+    Bitboard(int h,int wd):H(h),W(wd),NW((wd+63)/64),w((size_t)h*NW,0){}
+    uint64_t* row(int r){ return &w[(size_t)r*NW]; }
+    const uint64_t* row(int r) const { return &w[(size_t)r*NW]; }
+    bool get(int r,int c) const { return row(r)[c>>6]>>(c&63)&1; }
+    void set(int r,int c,bool v){ uint64_t b=1ULL<<(c&63); if(v) row(r)[c>>6]|=b; else row(r)[c>>6]&=~b; }
+    uint64_t tail() const { return (W&63)? (1ULL<<(W&63))-1 : ~0ULL; } // valid bits of the last word
+    void wall_border(){
+        for(int k=0;k<NW;k++){ row(0)[k]=~0ULL; row(H-1)[k]=~0ULL; }
+        for(int r=0;r<H;r++){ set(r,0,true); set(r,W-1,true); row(r)[NW-1]&=tail(); }
+    }
+};
+void ca_step(const Bitboard& in, Bitboard& out);
+std::vector<Rect> gen_caves(Map& m,RNG& rng);
+std::vector<Rect> generate_dungeon(Map& m,RNG& rng,Biome& biome);
+
+// ---------------- Combat/Status ----------------
+int xp_to_next(int plv);
+
+// ---------------- Inventory ----------------
+void pickup(Game& g);
+void use_item(Game& g,int idx);
+void drop_item(Game& g,int idx);
+
+// ---------------- Doors/Traps/Chests ----------------
+bool is_closed_door(const Map&m,int r,int c);
+void try_open_adjacent(Game& g);
+void search(Game& g);
+
+// ---------------- Terminal colors ----------------
+// Foreground-only palette, encoded once for the terminal's color depth. Mono emits no SGR at all.
+enum class ColorMode{ Mono, Ansi16, Ansi256, TrueColor };
+constexpr int kColorCount=(int)Color::FloorArmory+1;
+struct PaletteEntry{ uint8_t c256; uint8_t r,g,b; uint8_t c16; bool exact16; }; // exact16: c16 is the same color
+inline constexpr PaletteEntry palette[kColorCount]={
+    {  0,   0,  0,  0,  0,false}, // Default
+    {245, 138,138,138, 37,false}, // Wall
+    {240,  88, 88, 88, 90,false}, // Floor
+    { 33,   0,135,255, 94,false}, // Stairs
+    {179, 215,175, 95, 33,false}, // Door
+    {160, 215,  0,  0, 31,false}, // Trap
+    {213, 255,135,255, 95,false}, // Item
+    {178, 215,175,  0, 93,false}, // Chest
+    {208, 255,135,  0, 91,false}, // Mob
+    { 15, 255,255,255, 97,true }, // Player
+    {199, 255,  0,175, 35,false}, // Boss
+    { 45,   0,215,255, 96,false}, // Teleporter
+    {250, 188,188,188, 37,false}, // Legend
+    {130, 175, 95,  0, 33,false}, // WallLava
+    { 52,  95,  0,  0, 31,false}, // FloorLava
+    { 65,  95,135, 95, 32,false}, // WallSewer
+    { 22,   0, 95,  0, 90,false}, // FloorSewer
+    {137, 175,135, 95, 33,false}, // WallLibrary
+    { 94, 135, 95,  0, 90,false}, // FloorLibrary
+    { 67,  95,135,175, 34,false}, // WallArmory
+    { 60,  95, 95,135, 90,false}, // FloorArmory
+};
+struct TermColors{
+    ColorMode mode=ColorMode::Ansi256; std::array<std::string,kColorCount> sgr;
+    TermColors(){ set_mode(mode); }
+    void set_mode(ColorMode m){
+        mode=m;
+        for(int i=0;i<kColorCount;i++){
+            const PaletteEntry& p=palette[i]; std::string& out=sgr[i];
+            if(m==ColorMode::Mono) out.clear();
+            else if(i==(int)Color::Default) out="\x1b[0m";
+            else if(m==ColorMode::Ansi16 || p.exact16) out="\x1b["+std::to_string(p.c16)+"m"; // shortest form wins
+            else if(m==ColorMode::Ansi256) out="\x1b[38;5;"+std::to_string(p.c256)+"m";
+            else out="\x1b[38;2;"+std::to_string(p.r)+";"+std::to_string(p.g)+";"+std::to_string(p.b)+"m";
+        }
+    }
+};
+TermColors& term_colors();
+const std::string& color_code(Color c);
+ColorMode detect_color_mode();
+bool parse_color_mode(const std::string& s, ColorMode& out);
+
+// ---------------- Rendering ----------------
+struct RenderBuf{
+    int H,W; std::vector<char> ch; std::vector<Color> col;
+    RenderBuf(int h,int w):H(h),W(w),ch(h*w,' '),col(h*w,Color::Default){}
+    void reset(int h,int w){ H=h; W=w; ch.assign(h*w,' '); col.assign(h*w,Color::Default); }
+    void set(int r,int c,char g, Color co=Color::Default){ if(r<0||c<0||r>=H||c>=W) return; ch[r*W+c]=g; col[r*W+c]=co; }
+    void setcolor(int r,int c, Color co){ if(r<0||c<0||r>=H||c>=W) return; col[r*W+c]=co; }
+    void flush() const {
+        // the current color carries across rows; blanks take any foreground, so they never switch it.
+        // Rows are placed absolutely: a newline after a full-height last row would scroll the screen.
+        Color cur=Color::Default;
+        for(int r=0;r<H;r++){
+            io::move(r,0);
+            for(int c=0;c<W;c++){
+                Color wanted = col[r*W+c]; char g=ch[r*W+c];
+                if(wanted!=cur && g!=' '){ std::cout<<color_code(wanted); cur=wanted; }
+                std::cout<<g;
+            }
+        }
+        if(cur!=Color::Default) std::cout<<color_code(Color::Default);
+    }
+    // Only the cells that differ from prev (same size). Gaps of a few unchanged cells are rewritten
+    // rather than paying for another cursor move.
+    void flush_diff(const RenderBuf& prev) const {
+        constexpr int kMaxGap=4;
+        Color cur=Color::Default;
+        for(int r=0;r<H;r++){
+            int at=-1; // column the cursor sits at on this row, -1 = elsewhere
+            for(int c=0;c<W;c++){
+                int k=r*W+c;
+                if(ch[k]==prev.ch[k] && (col[k]==prev.col[k] || ch[k]==' ')) continue;
+                if(at<0 || c-at>kMaxGap){ io::move(r,c); at=c; }
+                for(;at<=c;at++){
+                    int j=r*W+at;
+                    if(col[j]!=cur && ch[j]!=' '){ std::cout<<color_code(col[j]); cur=col[j]; }
+                    std::cout<<ch[j];
+                }
+            }
+        }
+        if(cur!=Color::Default) std::cout<<color_code(Color::Default);
+    }
+};
+// Tile lists are LIFO; keep the lowest index so lookups match g.ents order.
+template<class P> int index_at(const Game& g,int r,int c,P pred){
+    int best=-1; if(!g.map.in(r,c)) return best;
+    for(int i=g.grid.first(r,c); i!=-1; i=g.grid.next[i]) if(!g.ents[i].gone && pred(g.ents[i]) && (best<0 || i<best)) best=i;
+    return best;
+}
+
+// ---------------- Frames ----------------
+// A frame is an immutable snapshot of one screen: the map/legend grid plus the HUD and log
+// text (cursor moves included). compose() fills it from g; present() writes it to the terminal.
+struct Frame{ RenderBuf rb{0,0}; std::string text; };
+constexpr int kLegendW=20, kHudRows=4;
+int view_h(const Game& g);
+int view_w(const Game& g);
+bool screen_too_small(const Game& g);
+void compose(Game& g, Frame& f);
+// What the terminal shows as of the last present(); diffs are taken against it.
+struct Screen{ RenderBuf rb{0,0}; std::string text; };
+Screen& screen();
+void present(const Frame& f);
+// Optional render thread. The simulation posts frames into a single atomic slot; posting over an
+// unconsumed frame drops it, so the terminal only ever sees the newest state. Presents are capped
+// at kMaxFps. The mutex/condvar only park the idle thread; the handoff itself is the slot exchange.
+struct Presenter{
+    static constexpr int kMaxFps=60;
+    std::atomic<Frame*> slot{nullptr}, spare{nullptr}; std::atomic<bool> busy{false}; std::atomic<uint64_t> dropped{0};
+    std::mutex mu; std::condition_variable cv; bool quit=false; std::thread th;
+    Presenter(): th(spawn_worker([this]{ loop(); })) {}
+    ~Presenter(){
+        sync();
+        { std::lock_guard<std::mutex> lk(mu); quit=true; } cv.notify_all(); th.join();
+        delete slot.exchange(nullptr); delete spare.exchange(nullptr);
+    }
+    // a recycled frame when one is free, else a new one
+    Frame* acquire(){ Frame* f=spare.exchange(nullptr); return f? f : new Frame; }
+    void post(Frame* f){
+        if(Frame* old=slot.exchange(f)){ dropped.fetch_add(1,std::memory_order_relaxed); recycle(old); }
+        { std::lock_guard<std::mutex> lk(mu); } cv.notify_all();
+    }
+    void recycle(Frame* f){ delete spare.exchange(f); }
+    // block until every posted frame is on screen (before anything else writes to stdout)
+    void sync(){ std::unique_lock<std::mutex> lk(mu); cv.wait(lk,[&]{ return !slot.load() && !busy.load(); }); }
+    void loop(){
+        auto next=std::chrono::steady_clock::now();
+        while(true){
+            { std::unique_lock<std::mutex> lk(mu); cv.wait(lk,[&]{ return quit || slot.load(); }); if(quit && !slot.load()) return; }
+            std::this_thread::sleep_until(next); // frame cap: later posts replace the pending one meanwhile
+            busy=true;
+            if(Frame* f=slot.exchange(nullptr)){ present(*f); recycle(f); }
+            next=std::chrono::steady_clock::now()+std::chrono::microseconds(1000000/kMaxFps);
+            { std::lock_guard<std::mutex> lk(mu); busy=false; } cv.notify_all();
+        }
+    }
+};
+void render(Game& g);
+void submit_frame(Game& g);
+// What a save file holds, detached from Game so it can be written off the main thread. The map is held as
+// immutable bands of rows shared between consecutive snapshots: a band is copied only when a cell in it
+// changed, so on a settled level a snapshot costs one compare pass plus the entity copy.
+struct SaveState{
+    static constexpr int kBandRows=16;
+    using Band=std::shared_ptr<const std::vector<uint8_t>>; // up to kBandRows*W cells of (tile<<1)|seen
+    int level=1, H=0, W=0, plv=1, xp=0; Options opt; Entity player; PlayerStatus pstat; Inventory inv; std::vector<int> kills;
+    std::vector<Entity> ents; std::vector<Band> bands;
+    int cell(int r,int c) const { return (*bands[r/kBandRows])[(size_t)(r%kBandRows)*W+c]; }
+};
+std::shared_ptr<const SaveState> snapshot(const Game& g, const SaveState* prev=nullptr);
+void write_save(const SaveState& s, std::ostream& f);
+bool commit_file(const std::string& path, const std::string& data);
+// The manual save and the autosave are separate files, so autosaving a fresh run never clobbers a kept save.
+constexpr const char* kSavePath="savegame.txt";
+constexpr const char* kAutosavePath="autosave.txt";
+bool save_game(const Game& g, const std::string& path=kSavePath);
+bool load_game(Game& g, const std::string& path=kSavePath);
+// Background autosave. The turn loop only takes a snapshot; this thread formats and commits it. A snapshot
+// posted while another is still queued replaces it, so a slow disk costs saves, never turns.
+struct Autosaver{
+    static constexpr int kEveryTurns=50;
+    std::string path; std::shared_ptr<const SaveState> last; int last_turn=0; // main thread only
+    std::mutex mu; std::condition_variable cv; std::shared_ptr<const SaveState> pending; bool busy=false, quit=false; std::thread th;
+    explicit Autosaver(std::string p): path(std::move(p)), th(spawn_worker([this]{ loop(); })) {}
+    ~Autosaver(){ { std::lock_guard<std::mutex> lk(mu); quit=true; } cv.notify_all(); th.join(); } // drains a queued save first
+    void post(const Game& g){
+        last=snapshot(g,last.get()); last_turn=g.turn;
+        { std::lock_guard<std::mutex> lk(mu); pending=last; } cv.notify_all();
+    }
+    void tick(const Game& g){ if(std::abs(g.turn-last_turn)>=kEveryTurns) post(g); }
+    // block until nothing is queued or being written (before anyone else touches the save file)
+    void sync(){ std::unique_lock<std::mutex> lk(mu); cv.wait(lk,[&]{ return !pending && !busy; }); }
+    void loop(){
+        while(true){
+            std::shared_ptr<const SaveState> s;
+            { std::unique_lock<std::mutex> lk(mu); cv.wait(lk,[&]{ return quit || pending; }); if(!pending) return; s=std::move(pending); pending=nullptr; busy=true; }
+            std::ostringstream f; write_save(*s,f); commit_file(path,f.str());
+            { std::lock_guard<std::mutex> lk(mu); busy=false; } cv.notify_all();
+        }
+    }
+};
+
+// ---------------- Input/Turns ----------------
+void move_or_attack(Game& g,int dr,int dc);
+
+// ---------------- AI ----------------
+// Small persistent pool: run(n,fn) hands out index chunks from a shared cursor, so idle
+// workers keep pulling work until the range is drained. The caller participates too.
+struct WorkPool{
+    std::vector<std::thread> workers; std::mutex mu; std::condition_variable wake, done;
+    std::function<void(int)> job; std::atomic<int> cursor{0}; int count=0, chunk=1, busy=0; uint64_t gen=0; bool quit=false;
+    explicit WorkPool(unsigned n){ for(unsigned i=0;i<n;i++) workers.push_back(spawn_worker([this]{ loop(); })); }
+    ~WorkPool(){ { std::lock_guard<std::mutex> lk(mu); quit=true; } wake.notify_all(); for(auto& t: workers) t.join(); }
+    void drain(){ int i; while((i=cursor.fetch_add(chunk))<count){ int end=std::min(count,i+chunk); for(int k=i;k<end;k++) job(k); } }
+    void loop(){
+        uint64_t seen=0;
+        while(true){
+            { std::unique_lock<std::mutex> lk(mu); wake.wait(lk,[&]{ return quit || gen!=seen; }); if(quit) return; seen=gen; }
+            drain();
+            { std::lock_guard<std::mutex> lk(mu); if(--busy==0) done.notify_one(); }
+        }
+    }
+    void run(int n, const std::function<void(int)>& fn, int serial_below=64){
+        if(workers.empty() || n<serial_below){ for(int i=0;i<n;i++) fn(i); return; }
+        { std::lock_guard<std::mutex> lk(mu); job=fn; count=n; chunk=std::max(1,n/(int)(4*(workers.size()+1))); cursor=0; busy=(int)workers.size(); gen++; }
+        wake.notify_all();
+        drain();
+        std::unique_lock<std::mutex> lk(mu); done.wait(lk,[&]{ return busy==0; });
+    }
+};
+enum class Intent:uint8_t{ Idle, Step, Attack };
+struct AiPlan{ int ent=-1; uint64_t seed=0; Intent kind=Intent::Idle; Pos to{}; };
+// Activation tiers: Dormant mobs (beyond wake_radius steps or cut off from the player) are
+// skipped entirely; Near mobs get one cheap action per turn; Visible mobs get the full AI.
+enum class AiTier:uint8_t{ Dormant, Near, Visible };
+
+// ---------------- Tips ----------------
+void load_tips_file(Content& c, const char* path);
+
+// ---------------- Setup ----------------
+void next_level(Game& g);
+void new_game(Game& g);
+
+// ---------------- Spells ----------------
+void cast_firebolt(Game& g,int dr,int dc);
+void cast_heal(Game& g);
+void cast_ice(Game& g,Pos target);
+void cast_shield(Game& g);
+void cast_fireball(Game& g, Pos target);
+int price_of(const Item& it);
+bool near_merchant(Game& g);
+
+// ---------------- Travel ----------------
+// Multi-turn commands: route once over remembered tiles (BFS), then play the steps back-to-back.
+// Frames are throttled; a hostile in view, lost HP, a keypress or a blocked step ends the run.
+enum class TravelGoal{ Explore, Teleporter, Item };
+constexpr int kTravelMaxSteps=1000;
+constexpr auto kTravelFrame=std::chrono::milliseconds(50);
+std::vector<Pos> travel_route(Game& g,TravelGoal goal);
+bool hostile_in_view(const Game& g);